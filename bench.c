@@ -0,0 +1,412 @@
+// Benchmarks of the editor core, without a terminal: kilo.c is built in
+// without its main() and the functions the keys end up in are called
+// directly, on a generated C file of `lines` lines (500000 by default).
+// Every benchmark reports its operations per second and their latencies,
+// the drawing ones also the bytes a frame sends to the terminal:
+//
+//   make bench && ./bench [lines]
+//
+// The frames go to /dev/null, the report to the standard output.
+#define KILO_HEADLESS
+#include "kilo.c"
+
+// the size of the screen the frames are drawn for
+#define BENCH_ROWS 50
+#define BENCH_COLS 160
+
+/*** measuring ***/
+
+// the latencies of the operations of one benchmark
+typedef struct benchStat {
+    const char *name;
+    long long *ns;
+    int len, cap;
+    long long total_ns;
+    long long bytes; // sent to the terminal, by the drawing benchmarks
+} benchStat;
+
+FILE *report;
+
+long long benchNowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+benchStat benchBegin(const char *name) {
+    return (benchStat){name, NULL, 0, 0, 0, 0};
+}
+
+// one more operation, that started at `start`
+void benchAdd(benchStat *b, long long start) {
+    long long ns = benchNowNs() - start;
+    if (b->len == b->cap) {
+        b->cap = editorGrowCap(b->cap, b->len + 1);
+        b->ns = realloc(b->ns, sizeof(long long) * b->cap);
+    }
+    b->ns[b->len++] = ns;
+    b->total_ns += ns;
+}
+
+int benchCompare(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// in microseconds, the latency `p` percent of the operations stay within
+double benchPercentile(benchStat *b, int p) {
+    return b->ns[(long long)(b->len - 1) * p / 100] / 1000.0;
+}
+
+void benchHeader() {
+    fprintf(report, "%-13s %7s %11s %10s %10s %10s %10s\n", "benchmark",
+            "ops", "ops/s", "p50 us", "p90 us", "p99 us", "max us");
+}
+
+// print a line for `b` and free it. `extra` goes at the end, if any
+void benchReport(benchStat *b, const char *extra) {
+    if (b->len == 0) {
+        return;
+    }
+    qsort(b->ns, b->len, sizeof(long long), benchCompare);
+    double secs = b->total_ns / 1e9;
+    fprintf(report, "%-13s %7d %11.1f %10.1f %10.1f %10.1f %10.1f%s%s\n",
+            b->name, b->len, secs > 0 ? b->len / secs : 0.0,
+            benchPercentile(b, 50), benchPercentile(b, 90),
+            benchPercentile(b, 99), benchPercentile(b, 100),
+            extra ? "  " : "", extra ? extra : "");
+    free(b->ns);
+}
+
+// reports the bytes per frame of a drawing benchmark
+void benchReportFrames(benchStat *b) {
+    char extra[64];
+    snprintf(extra, sizeof(extra), "%.0f bytes/frame",
+             b->len ? (double)b->bytes / b->len : 0.0);
+    benchReport(b, extra);
+}
+
+// reports the throughput of a benchmark that went through `bytes` each time
+void benchReportBytes(benchStat *b, long long bytes) {
+    char extra[64];
+    double secs = b->total_ns / 1e9;
+    snprintf(extra, sizeof(extra), "%.0f MB/s",
+             secs > 0 ? (double)bytes * b->len / 1e6 / secs : 0.0);
+    benchReport(b, extra);
+}
+
+/*** the file ***/
+
+// write `lines` lines of C, with everything the highlighter knows about in
+// them, to a new file named like `path`. Returns its size
+long long benchGenerate(char *path, int lines) {
+    int fd = mkstemps(path, 2);
+    if (fd == -1) {
+        die("mkstemps");
+    }
+    FILE *f = fdopen(fd, "w");
+    static const char *body[] = {
+        "/* function %d of the benchmark, a block comment",
+        " * that goes over two lines */",
+        "static int function_%d(int a, const char *s) {",
+        "\t// a line comment after a tab",
+        "    int x = a * %d + 0x1f;",
+        "    if (s[0] == 'q' && x > 10) {",
+        "        return printf(\"%%d: %%s\\n\", x, s);",
+        "    }",
+        "    return x - 1.5e3;",
+        "}",
+    };
+    int n = sizeof(body) / sizeof(body[0]);
+    for (int i = 0; i < lines; i++) {
+        fprintf(f, body[i % n], i / n);
+        fputc('\n', f);
+    }
+    long long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+// free a buffer no window shows, and that nothing else refers to
+void benchBufferFree(editorBuffer *b) {
+    editorBuffer *buf = E.buf;
+    E.buf = b;
+    for (rowLeaf *leaf = b->rows_head, *next; leaf; leaf = next) {
+        for (int i = 0; i < leaf->n; i++) {
+            editorFreeRow(&leaf->rows[i]);
+        }
+        next = leaf->next;
+        free(leaf);
+    }
+    if (b->map_fd != -1) {
+        munmap(b->map, b->map_mapped);
+        close(b->map_fd);
+    } else {
+        free(b->map);
+    }
+    editorUndoClear();
+    free(b->hl_stale);
+    free(b->file_name);
+    E.buf = buf;
+    int i = 0;
+    while (E.bufs[i] != b) {
+        i++;
+    }
+    memmove(&E.bufs[i], &E.bufs[i + 1],
+            sizeof(editorBuffer *) * (E.num_bufs - i - 1));
+    E.num_bufs--;
+    free(b);
+}
+
+/*** benchmarks ***/
+
+// editorOpen() into a buffer of its own each time
+void benchOpen(char *path, long long size) {
+    benchStat b = benchBegin("open");
+    editorBuffer *buf = E.buf;
+    for (int i = 0; i < 5; i++) {
+        E.buf = editorBufferNew();
+        long long start = benchNowNs();
+        editorOpen(path);
+        benchAdd(&b, start);
+        editorBuffer *opened = E.buf;
+        E.buf = buf;
+        benchBufferFree(opened);
+    }
+    benchReportBytes(&b, size);
+}
+
+// editorOpen() of a file that has a cache, into a buffer of its own each time.
+// The cache is made once, from the rows with every comment state known, in
+// `dir`
+void benchOpenCached(char *path, long long size, char *dir) {
+    E.cache_dir = dir;
+    editorBuffer *buf = E.buf;
+    E.buf = editorBufferNew();
+    editorOpen(path);
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, 0); row;
+         row = editorRowIterNext(&it)) {
+        editorHighlightRow(row, 0, -1);
+    }
+    E.buf->hl_ready = E.buf->num_rows;
+    editorCacheSave();
+    char *cache_path = NULL;
+    char *name = editorCachePath(&cache_path);
+    editorBuffer *opened = E.buf;
+    E.buf = buf;
+    benchBufferFree(opened);
+
+    benchStat b = benchBegin("open_cached");
+    for (int i = 0; i < 5; i++) {
+        E.buf = editorBufferNew();
+        long long start = benchNowNs();
+        editorOpen(path);
+        benchAdd(&b, start);
+        opened = E.buf;
+        E.buf = buf;
+        benchBufferFree(opened);
+    }
+    benchReportBytes(&b, size);
+
+    // the other benchmarks start from a file that was never opened
+    if (name) {
+        unlink(name);
+    }
+    rmdir(dir);
+    free(name);
+    free(cache_path);
+    E.cache_dir = NULL;
+}
+
+// editorInsertRow() of a line anywhere in the file
+void benchInsertRow() {
+    benchStat b = benchBegin("insert_row");
+    char line[] = "    int inserted = function_1(2, \"three\"); // four";
+    for (int i = 0; i < 20000; i++) {
+        int at = rand() % (E.buf->num_rows + 1);
+        long long start = benchNowNs();
+        editorInsertRow(at, line, sizeof(line) - 1);
+        benchAdd(&b, start);
+    }
+    benchReport(&b, NULL);
+}
+
+// editorRowInsertChar() anywhere in the file, most rows are still mapped
+// and get a copy of their own first
+void benchInsertChar() {
+    benchStat b = benchBegin("insert_char");
+    for (int i = 0; i < 200000; i++) {
+        erow *row = editorRowAt(rand() % E.buf->num_rows);
+        int at = rand() % (row->size + 1);
+        long long start = benchNowNs();
+        editorRowInsertChar(row, at, 'a' + i % 26);
+        benchAdd(&b, start);
+    }
+    benchReport(&b, NULL);
+}
+
+// editorUpdateSyntax() of the rows from the top of the file down, as the
+// rows of a new file are highlighted
+void benchUpdateSyntax() {
+    benchStat b = benchBegin("update_syntax");
+    long long bytes = 0;
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, 0); row && b.len < 200000;
+         row = editorRowIterNext(&it)) {
+        long long start = benchNowNs();
+        editorUpdateSyntax(row);
+        benchAdd(&b, start);
+        bytes += row->size;
+    }
+    // bytes per row on average, as benchReportBytes() takes them
+    benchReportBytes(&b, b.len ? bytes / b.len : 0);
+}
+
+// editorFindCallback() as the query is typed, and as the arrows go from
+// match to match
+void benchFind() {
+    benchStat typed = benchBegin("find_type");
+    benchStat next = benchBegin("find_next");
+    benchStat regex = benchBegin("find_regex");
+    static const char *queries[] = {"return printf", "x > 10", "0x1f;"};
+    for (int q = 0; q < 3; q++) {
+        editorSearchBegin();
+        char query[32];
+        int len = strlen(queries[q]);
+        for (int i = 1; i <= len; i++) {
+            snprintf(query, sizeof(query), "%.*s", i, queries[q]);
+            long long start = benchNowNs();
+            editorFindCallback(query, query[i - 1]);
+            benchAdd(&typed, start);
+        }
+        for (int i = 0; i < 5000; i++) {
+            long long start = benchNowNs();
+            editorFindCallback(query, ARROW_DOWN);
+            benchAdd(&next, start);
+        }
+        E.buf->search.active = 0;
+    }
+    for (int i = 0; i < 10; i++) {
+        editorSearchBegin();
+        long long start = benchNowNs();
+        editorFindCallback("/function_[0-9]+5\\(", '(');
+        benchAdd(&regex, start);
+        E.buf->search.active = 0;
+    }
+    E.buf->search.match_y = -1;
+    benchReport(&typed, NULL);
+    benchReport(&next, NULL);
+    benchReport(&regex, NULL);
+}
+
+// draw a frame, with editorDrawRows() and the rest of editorRefreshScreen()
+void benchFrame(benchStat *b) {
+    long long start = benchNowNs();
+    editorRefreshScreen();
+    benchAdd(b, start);
+    b->bytes += E.frame.len;
+}
+
+// frames after the cursor moved down a line, past the bottom of the screen,
+// on a terminal that scrolls, then a screen at a time, then with a character
+// typed in between
+void benchDraw() {
+    E.term_level = 2;
+    E.win->cx = E.win->cy = E.win->row_off = E.win->col_off = 0;
+    editorRefreshScreen();
+
+    // from the top again once the end of the file is on the screen
+    benchStat line = benchBegin("draw_line");
+    E.win->cy = E.win->screen_rows - 1;
+    for (int i = 0; i < 5000; i++) {
+        E.win->cy = (E.win->cy + 1) % E.buf->num_rows;
+        benchFrame(&line);
+    }
+    benchReportFrames(&line);
+
+    benchStat page = benchBegin("draw_page");
+    for (int i = 0; i < 2000; i++) {
+        E.win->cy = E.win->row_off + 2 * E.win->screen_rows - 1;
+        if (E.win->cy >= E.buf->num_rows) {
+            E.win->cy = 0;
+        }
+        benchFrame(&page);
+    }
+    benchReportFrames(&page);
+
+    benchStat typed = benchBegin("draw_type");
+    E.win->cy = E.buf->num_rows / 2;
+    E.win->cx = 0;
+    for (int i = 0; i < 5000; i++) {
+        editorInsertChar('a' + i % 26);
+        benchFrame(&typed);
+    }
+    benchReportFrames(&typed);
+}
+
+// editorSave() in the background, until the saving thread is done
+void benchSave() {
+    benchStat b = benchBegin("save");
+    long long bytes = editorRowsLength();
+    for (int i = 0; i < 3; i++) {
+        long long start = benchNowNs();
+        editorSave();
+        while (E.buf->save_job) {
+            editorSaveIdle();
+            poll(NULL, 0, 1);
+        }
+        benchAdd(&b, start);
+        // the next save has something to write again
+        editorRowInsertChar(editorRowAt(i), 0, 's');
+    }
+    benchReportBytes(&b, bytes);
+}
+
+int main(int argc, char *argv[]) {
+    int lines = argc >= 2 ? atoi(argv[1]) : 500000;
+    if (lines < 1) {
+        fprintf(stderr, "usage: %s [lines]\n", argv[0]);
+        return 1;
+    }
+    // the frames are drawn for nobody
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    int null = open("/dev/null", O_WRONLY);
+    if (report == NULL || null == -1 || dup2(null, STDOUT_FILENO) == -1) {
+        perror("/dev/null");
+        return 1;
+    }
+    close(null);
+
+    const char *tmp = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/kilo-bench-XXXXXX.c", tmp ? tmp : "/tmp");
+    long long size = benchGenerate(path, lines);
+
+    initEditor();
+    // no cache from a run before, and none for the runs after
+    free(E.cache_dir);
+    E.cache_dir = NULL;
+    editorSetScreenSize(BENCH_ROWS, BENCH_COLS);
+    srand(1);
+    fprintf(report, "%d lines, %lld bytes, %d threads\n", lines, size,
+            E.pool_size);
+    benchHeader();
+    benchOpen(path, size);
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/kilo-bench-XXXXXX", tmp ? tmp : "/tmp");
+    if (size >= KILO_CACHE_MIN && mkdtemp(dir)) {
+        benchOpenCached(path, size, dir);
+    }
+    editorOpen(path);
+    benchUpdateSyntax();
+    benchFind();
+    benchDraw();
+    benchInsertRow();
+    benchInsertChar();
+    benchSave();
+
+    unlink(path);
+    fclose(report);
+    return 0;
+}
@@ -5,21 +5,117 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h> // unix standard
+// vector instructions for the highlighter's scanning loops, see
+// editorScanWord()
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+// how a followed file tells that it changed, see editorFollowWatch()
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
 
 /*** defines ***/
 
 #define KILO_VERSION "0.0.1"
 #define KILO_TAB_STOP 8
 #define KILO_QUIT_TIMES 1
+// the maximal number of rows kept together in one leaf of the row tree
+#define ROW_LEAF_MAX 256
+// rows above and below the screen that keep their render and highlight
+#define KILO_VIEW_ROWS 256
+// the most windows the screen is split into
+#define KILO_WINDOWS_MAX 16
+// how many stale rows are highlighted again each time the editor is idle
+#define KILO_HL_IDLE_ROWS 2000
+// rows below the highlighted part of the file that are highlighted right away
+// when they have to be shown, larger gaps are left to the highlighting thread
+#define KILO_HL_SYNC_ROWS 1024
+// rows per batch handed to the highlighting thread
+#define KILO_HL_JOB_ROWS 32768
+// bytes of input taken with one read()
+#define KILO_INPUT_BUF 4096
+// milliseconds to wait for the rest of an escape sequence
+#define KILO_ESC_TIMEOUT 100
+// milliseconds to wait for the terminal to tell its size, see editorQuerySize()
+#define KILO_QUERY_TIMEOUT 1000
+// seconds a status message stays on the screen
+#define KILO_MSG_SECS 5
+// rows per chunk of a search on the thread pool
+#define KILO_POOL_CHUNK 4096
+// the most threads of the pool, the KILO_THREADS environment variable picks
+// how many up to that, the default is one per processor
+#define KILO_POOL_MAX 64
+// pieces of the file written with one writev() when saving
+#define KILO_IOV_BATCH 1024
+// runs of untouched lines at least this long are copied from the opened file
+// by the kernel when saving, see editorWriterSpanEnd()
+#define KILO_COPY_MIN (64 * 1024)
+// bytes copied by the kernel at a time, so a save shows its progress and can
+// be cancelled in between
+#define KILO_COPY_SLICE (16 * 1024 * 1024)
+// milliseconds between redraws of the progress of a save
+#define KILO_SAVE_TICK 100
+// bytes of a followed file read at a time, see editorFollowRead()
+#define KILO_FOLLOW_BATCH (1024 * 1024)
+// milliseconds between redraws while a followed file grows
+#define KILO_FOLLOW_FRAME_MS 33
+// milliseconds between looks at a followed file that inotify doesn't watch,
+// or whose name is gone after it was rotated
+#define KILO_FOLLOW_POLL_MS 250
+// files of at least this many bytes keep their line breaks and comment states
+// in a cache file, so they open at once the next time, see editorCacheLoad()
+#define KILO_CACHE_MIN (4 * 1024 * 1024)
+// how many pages of a file, of how many bytes, are hashed to tell whether it
+// is still the file a cache was made of
+#define KILO_CACHE_SAMPLES 64
+#define KILO_CACHE_PAGE 4096
+// the bit of an offset in a cache file that says the line ended in "\r\n"
+#define KILO_CACHE_CR (1ull << 63)
+// the largest count of a bound like {2,5} in a regex
+#define KILO_RE_DUP_MAX 255
+// the most NFA nodes a regex may compile to
+#define KILO_RE_NODES 8192
+// DFA states each thread keeps for a regex before it starts over, and the
+// size of the hash table that finds them (a power of two, and larger)
+#define KILO_RE_STATES 512
+#define KILO_RE_TABLE 1024
+// rows whose search matches are kept for drawing them, see editorMatchSpans()
+#define KILO_MATCH_CACHE 128
+// bytes of each chunk of the undo arena, see `undoLog`
+#define KILO_UNDO_CHUNK (64 * 1024)
+// megabytes the undo log may hold before the oldest steps are dropped, the
+// KILO_UNDO_MB environment variable sets another limit
+#define KILO_UNDO_MB 64
+// set to 0 to build without the highlighting thread and the thread pool (and
+// without pthreads)
+#ifndef KILO_HL_THREAD
+#define KILO_HL_THREAD 1
+#endif
+// set to 1 to build with the profiling overlay (Ctrl-P) and the trace file
+// KILO_TRACE names, see `editorProfile`. Without it the counting and timing
+// compile to nothing
+#ifndef KILO_PROFILE
+#define KILO_PROFILE 0
+#endif
 
 // ^a-^z: 1-26, 0x1f = 0b0001_1111
 // In C, you generally specify bitmasks using hexadecimal, since C doesn't have
@@ -42,6 +138,8 @@ enum editorKey {
     END_KEY,
     PAGE_UP,
     PAGE_DOWN,
+    PASTE_START, // \x1b[200~, see editorReadPaste()
+    KEY_NONE,    // input that isn't a key, see editorReadKey()
 };
 
 // it contains the possible values that the `hl` array can contain
@@ -59,8 +157,40 @@ enum editorHighlight {
 #define HL_HIGHLIGHT_NUMBERS (1 << 0)
 #define HL_HIGHLIGHT_STRINGS (1 << 1)
 
+// character classes of a syntax, see editorSyntaxCompile()
+#define CLS_SEP (1 << 0)     // ends a word
+#define CLS_WORD (1 << 1)    // can't end a word or start a string or comment
+#define CLS_COMMENT (1 << 2) // may start a comment
+#define CLS_QUOTE (1 << 3)   // starts a string
+#define CLS_NUMBER (1 << 4)  // may start or go on with a number
+
 /*** data ***/
 
+// one slot of a keyword hash table, see editorSyntaxCompile()
+typedef struct editorKeyword {
+    const char *word; // NULL if the slot is empty
+    int len;          // length without the trailing '|'
+    unsigned char hl; // HL_KEYWORD1 or HL_KEYWORD2
+} editorKeyword;
+
+// lookup tables built from an editorSyntax: its keywords in an open
+// addressing hash table and a class (CLS_*) for every byte. What the syntax
+// has and doesn't have is in the classes, so the highlighter only looks
+// closer at the bytes that may start something
+typedef struct editorSyntaxTables {
+    editorKeyword *slots;
+    unsigned int mask; // number of slots minus one
+    int max_len;       // length of the longest keyword
+    unsigned char cls[256];
+    // lengths of the comment delimiters, 0 if there are none (multi-line
+    // comments need both)
+    int slcs_len, mlcs_len, mlce_len;
+    // whether all letters, digits and '_' are CLS_WORD and spaces are plain
+    // separators, which allows the vector scans over them
+    int fast_word;
+    int fast_space;
+} editorSyntaxTables;
+
 struct editorSyntax {
     // the name of the filetype that will be displayed in the status bar
     char *file_type;
@@ -73,44 +203,639 @@ struct editorSyntax {
     // a bit field that will contain flags for whether to highlight numbers and
     // whether to highlight strings for the filetype
     int flags;
+    // the characters that quote strings, NULL for " and '
+    char *quotes;
+    // built the first time the syntax is selected
+    editorSyntaxTables *tables;
 };
 
+// one slot of the hash table that finds the syntax for a file by its name
+// (like "Makefile") or its extension (like ".c"), see editorSyntaxAdd()
+typedef struct syntaxMatch {
+    const char *match; // NULL if the slot is empty
+    struct editorSyntax *syntax;
+} syntaxMatch;
+
 // The characters we store in memory are not always the same as the characters
 // we draw on the screen
-typedef struct erow {
-    int index;    // index in the file
-    int size;     // size of the raw string (file content)
-    int rsize;    // size of the rendered string (screen content)
-    char *chars;  // the actual raw characters from the file
+// A character of a row that doesn't take one byte and one column: a tab, or
+// anything that isn't ASCII. `cx`, `ri` and `rx` are where it starts in
+// `chars`, in `render` and on the screen, `len`, `rlen` and `w` how much it
+// takes of each
+typedef struct colChar {
+    int cx, ri, rx;
+    unsigned char len, rlen, w;
+} colChar;
+
+// the colChars of a row in order, `tabs` of them are tabs. Everything between
+// two of them is ASCII, one byte and one column each, see editorColsBuild()
+typedef struct colMap {
+    int n, tabs;
+    colChar at[];
+} colMap;
+
+// How a row is shown. Only the rows around the screen have one, it is built
+// when the row is drawn and dropped once the row is far enough off the screen
+// (see editorKeepRows()), so a line of the file costs its text and an erow
+typedef struct rowView {
+    int rsize; // size of the rendered string (screen content)
+    int rcap;  // allocated size of `render` and `hl`, which are just as long
     char *render; // the characters as they appear on screen, like tabs expanded
     unsigned char *hl; // highlight
+    // where the tabs and other characters are, built along with `render`
+    colMap *cols;
+    // stamped from E.version_clock when `hl` was last guessed for a row below
+    // hl_ready (editorPrepareGuessed())
+    unsigned int hl_version;
+} rowView;
+
+typedef struct erow {
+    int index; // index in the file, refreshed whenever the row is looked up
+    int size;  // size of the raw string (file content)
+    // allocated size of `chars`. A `cap` of 0 means `chars` points into
+    // the buffer's `map`, the mapped file (or the copy of the file on the heap)
+    int cap;
     int hl_open_comment;
+    char *chars; // the actual raw characters from the file
+    rowView *view; // NULL while the row is away from the screen
+    // stamped from E.version_clock whenever `chars` is about to change
+    // (editorRowReserve())
+    unsigned int version;
 } erow;
 
+// The rows of the file are stored in leaves holding up to ROW_LEAF_MAX
+// consecutive rows. The leaves are the nodes of a treap (a binary search tree
+// that is kept balanced by random priorities), ordered by their position in
+// the file, and each node knows how many rows and bytes its subtree holds.
+// Finding, inserting or deleting the n-th row (or the row at some offset of
+// the file) walks one path from the root, so it costs O(log n) instead of
+// moving the whole tail of one big array
+typedef struct rowLeaf {
+    erow rows[ROW_LEAF_MAX];
+    int n;          // number of rows used in this leaf
+    int total;      // number of rows in this subtree
+    // bytes of the rows of this leaf and of this subtree, a newline counted
+    // after every row, as the file is saved
+    long long bytes, total_bytes;
+    unsigned prio;  // heap priority of the treap
+    struct rowLeaf *left, *right;
+    struct rowLeaf *prev, *next; // neighbouring leaves in file order
+} rowLeaf;
+
+// walks the rows in file order without looking each one up from the root
+typedef struct rowIter {
+    rowLeaf *leaf;
+    int slot;  // position inside the leaf
+    int index; // position in the file
+} rowIter;
+
+// buffers to render and highlight rows in that have no view of their own, see
+// editorHighlightScratch()
+typedef struct hlScratch {
+    char *render;
+    unsigned char *hl;
+    int cap;
+} hlScratch;
+
+// A batch of consecutive rows below hl_ready handed to the highlighting
+// thread. The thread never looks at the rows themselves: their characters are
+// captured when the job is posted (rows that point into the mapping are not
+// copied, it doesn't change), and the results are only taken over by rows that
+// still have the version they had back then
+typedef struct hlJobRow {
+    const char *chars;
+    int size;
+    unsigned int version;
+    // filled in by the thread
+    int hl_open_comment;
+} hlJobRow;
+
+typedef struct hlJob {
+    struct editorBuffer *buf; // whose rows they are
+    int start;                // index of the first row
+    int count;
+    int in_comment; // whether the row above `start` ends inside a comment
+    struct editorSyntax *syntax;
+    unsigned int epoch; // hl_epoch when the job was posted
+    char *copy;         // characters of the rows that own them
+    hlJobRow *rows;
+} hlJob;
+
+enum hlJobState { HL_JOB_IDLE = 0, HL_JOB_QUEUED, HL_JOB_DONE };
+
+// One character on the screen, the `len` bytes of its UTF-8 (with the zero
+// width characters that go with it, as many as fit), or the right half of a
+// wide character if `len` is 0. `attr` is the SGR foreground color (30-37, or
+// 0 for the default color) plus CELL_INVERSE for inverted colors
+#define CELL_INVERSE 0x80
+#define CELL_BYTES 8
+
+typedef struct screenCell {
+    char ch[CELL_BYTES];
+    unsigned char len;
+    unsigned char attr;
+} screenCell;
+
+// the longest SGR sequence a cell attribute needs, "\x1b[0;7;37m" and room
+// for a third digit
+#define CELL_SGR_MAX 12
+
+// A regex as parsed, a tree of these nodes before it is compiled. RA_CLASS
+// matches a byte of set `a`, RA_CAT and RA_ALT join `a` and `b`, RA_REPEAT
+// repeats `a` `min` to `max` times (-1 for no limit)
+enum regexAstType { RA_EMPTY, RA_CLASS, RA_BOL, RA_EOL, RA_CAT, RA_ALT,
+                    RA_REPEAT };
+
+typedef struct regexAst {
+    int type;
+    int a, b;
+    int min, max;
+} regexAst;
+
+typedef struct regexParser {
+    const char *p; // the rest of the pattern
+    regexAst *ast;
+    int len, cap;
+    unsigned char (*classes)[32]; // sets of bytes, one bit for each
+    int class_len, class_cap;
+    int error;
+} regexParser;
+
+// the operations of the NFA: read a byte of a set, go on at both `out` and
+// `out1`, hold only at the start or the end of the text, and done
+enum regexOp { RE_CLASS, RE_SPLIT, RE_BOL, RE_EOL, RE_MATCH };
+
+typedef struct regexNode {
+    int op;
+    int out, out1; // the nodes after this one, `out1` only for RE_SPLIT
+    int cls;       // RE_CLASS: which set of bytes
+} regexNode;
+
+// a state of the lazy DFA: a set of NFA nodes the search can be at
+typedef struct regexState {
+    int first, len; // its nodes in `set_nodes`
+    unsigned int hash;
+    int match;     // 1 if a match ends here
+    int end_match; // 1 if a match ends here when the text does, -1 unknown
+    int next[256]; // the state after each byte, -1 until it is needed
+} regexState;
+
+// What a thread needs to match a regex: the DFA states it built so far, and
+// room for the closures and the threads of the Pike VM (all of them sized by
+// the number of NFA nodes). Every thread of the pool has its own
+typedef struct regexRun {
+    regexState *states;
+    int len, cap;
+    int *set_nodes;
+    int set_len, set_cap;
+    int *table;   // KILO_RE_TABLE indices into `states`, -1 for none
+    int start[2]; // the state to start in, inside the text or at its start
+    unsigned int *mark; // nodes already taken in this round, see regexClosure()
+    unsigned int gen;
+    int *stack;
+    int *set;
+    int *list[2]; // threads of the VM: node and where the thread started
+} regexRun;
+
+typedef struct regex {
+    regexNode *nodes;
+    int len, cap;
+    int start;
+    unsigned char (*classes)[32];
+    regexRun *runs;
+    int run_count;
+} regex;
+
+// What the search and replace prompts look for. A query that starts with '/'
+// is a POSIX extended regular expression, "//" starts a plain query with a '/'
+typedef struct searchPattern {
+    int is_regex;
+    char *text; // without the '/' in front
+    int len;
+    regex re; // with a run for every thread of the pool
+} searchPattern;
+
+// the matches of the search query in a row, so that drawing them again
+// doesn't search the row again, see editorMatchSpans()
+typedef struct matchSpans {
+    erow *row;            // NULL if the slot is empty
+    unsigned int version; // of the row when they were found
+    unsigned int query;   // `generation` of the search index then
+    int *spans;           // start and length in `chars` of each match
+    int count, cap;
+} matchSpans;
+
+// a row with matches of the search query, see editorSearchUpdate()
+typedef struct searchRow {
+    erow *row;
+    int index;  // of the row
+    int count;  // matches in the row
+    int before; // matches in the rows above it
+} searchRow;
+
+// rows with matches, in order
+typedef struct searchList {
+    searchRow *rows;
+    int len, cap;
+    int total; // matches in all of them
+} searchList;
+
+// The rows that contain the query of the search prompt, in order. A query
+// that contains the previous one can only match in those rows, so only they
+// are searched again as the query grows. No rows are inserted or deleted
+// while the prompt is open, so `row` stays valid until it closes
+typedef struct searchIndex {
+    int active;  // 1 while the search prompt is open
+    int invalid; // 1 if the query is not a valid regex
+    searchPattern pattern;
+    unsigned int generation; // counts the queries
+    searchList found;
+    int current; // which match the cursor is on, from 1, 0 if none
+    // the match the cursor is on, `match_y` is -1 if none
+    int match_y, match_x, match_len;
+    // every match on the screen is shown while the prompt is open
+    matchSpans cache[KILO_MATCH_CACHE];
+} searchIndex;
+
+// A piece of work for the thread pool, split into `chunks` that are run by
+// whichever thread takes them first, see editorPoolRun()
+typedef struct poolTask {
+    void (*run)(void *arg, int chunk, int worker);
+    void *arg;
+    int chunks;
+    int next;   // the next chunk to take
+    int active; // workers that joined the task and are not done with it yet
+} poolTask;
+
+// about KILO_POOL_CHUNK consecutive rows, the unit of work of the searches
+// on the pool. `leaf` holds the first of them
+typedef struct rowChunk {
+    rowLeaf *leaf;
+    int start; // index of the first row
+    int count;
+} rowChunk;
+
+// the new text of a row that replace-all changes
+typedef struct replaceRow {
+    erow *row;
+    int index;
+    int count; // matches replaced
+    char *chars;
+    int size;
+} replaceRow;
+
+typedef struct replaceList {
+    replaceRow *rows;
+    int len, cap;
+    int total; // matches replaced in all of them
+} replaceList;
+
+// what the chunks of a find-all or a replace-all on the pool share. Every
+// chunk has its own list of results, so the threads never write to the same
+typedef struct searchJob {
+    searchPattern *pattern;
+    rowChunk *chunks;
+    searchList *found; // find-all
+    const char *with;  // replace-all: the text that replaces each match
+    int with_len;
+    replaceList *replaced;
+} searchJob;
+
+// A piece of the undo arena. The bytes of the records are appended at the end
+// of the newest chunk and dropped from the start of the oldest one
+typedef struct undoChunk {
+    struct undoChunk *prev, *next;
+    size_t used, cap;
+    char data[];
+} undoChunk;
+
+enum undoType { UNDO_INSERT, UNDO_DELETE };
+
+// One change of the text: `len` bytes inserted at or deleted from position
+// `x` of row `y`. The text is seen as every row followed by a newline, so
+// the bytes may include newlines, which split or join rows. Row `y` may be
+// the one after the last row, where inserted lines are appended
+typedef struct undoRecord {
+    int type;
+    unsigned int step; // the keypress it belongs to, undone as a whole
+    int y, x;
+    int len;
+    int typed; // a typed character later ones may be merged into
+    char *bytes;
+    undoChunk *chunk; // holding `bytes`
+    int cy, cx;       // the cursor when the step started
+} undoRecord;
+
+// The changes made to the file, oldest first, so that undoing costs as much
+// as the changes did and not the size of the file. Records [0, at) can be
+// undone and [at, len) redone, a new change drops the latter
+typedef struct undoLog {
+    undoRecord *records;
+    int len, cap, at;
+    undoChunk *head, *tail; // the arena, oldest chunk first
+    size_t size;            // bytes held by the records and the arena
+    size_t limit;           // of `size`, the oldest steps go beyond it
+    unsigned int step;      // of the keypress being handled
+    int step_cy, step_cx;   // the cursor before it
+    unsigned int skip;      // a step too large to be kept, 0 if none
+    int paused;             // nothing is recorded while it is above 0
+} undoLog;
+
+// bytes being written to a file in batches for writev(), see
+// editorWriterAppend()
+typedef struct fileWriter {
+    int fd;
+    struct iovec iov[KILO_IOV_BATCH];
+    int count;
+    long long written;
+    // the mapped file, for copying from it with copy_file_range(). -1 if
+    // there is none, or once that turned out not to work
+    int copy_fd;
+    // where `written` is told to the main thread after each batch, and a flag
+    // that stops the write when it is set. NULL if not needed
+    long long *progress;
+    int *cancel;
+} fileWriter;
+
+// A piece of the file as it was when a save started: bytes of the mapping,
+// which never change, or lines copied from rows that had been edited
+typedef struct savePiece {
+    int mapped; // whether `off` is in the mapping or in `copy` of the job
+    size_t off;
+    size_t len;
+} savePiece;
+
+// A save running in the background, see editorSaveStart(). The main thread
+// sets it up and doesn't change it until `done` is set, apart from `cancel`
+typedef struct saveJob {
+    char *path; // the file, with symbolic links resolved
+    char *tmp;  // the new file that replaces it, being written
+    int fd;     // of `tmp`
+    const char *map;
+    int map_fd;
+    savePiece *pieces;
+    int len, cap;
+    char *copy;
+    size_t copy_len, copy_cap;
+    long long total; // bytes in all pieces
+    int dirty;       // the buffer's `dirty` when the snapshot was taken
+    long long start; // editorNowMs() then
+    // written by the saving thread and read by the main thread
+    long long written;
+    int cancel;
+    int done;
+    long long result; // bytes written or -1 once `done` is set
+    int error;        // errno if it failed
+} saveJob;
+
+// a growing buffer of bytes to write() to the terminal at once
+struct abuf {
+    char *b;
+    int len;
+    int cap;
+};
+
+#define ABUF_INIT {NULL, 0, 0}
+
 struct termios orig_termios;
 
-struct editorConfig {
+// The start of a cache file, see editorCacheSave(). The file has to match all
+// of it to be split with the cache. After it come the path of the file
+// (padded to 8 bytes), `num_rows` + 1 offsets and a bit per row for its
+// `hl_open_comment`
+typedef struct cacheHeader {
+    char magic[8]; // "kilo" and the version of the format
+    unsigned long long size, dev, ino;
+    long long mtime_sec, mtime_nsec;
+    unsigned long long content; // hash of pages spread over the file
+    unsigned long long syntax;  // hash of what the comment states depend on
+    unsigned long long path_len;
+    unsigned long long num_rows;
+} cacheHeader;
+
+// A file that is read as it grows, like `tail -f` does, see
+// editorFollowStart(). The buffer is read-only meanwhile
+typedef struct followState {
+    int fd;      // the file being read, -1 if the buffer doesn't follow it
+    int wd;      // its inotify watch, -1 if none
+    off_t off;   // the bytes of it the rows hold
+    dev_t dev;   // which file `fd` is, to notice that the name
+    ino_t ino;   //  refers to another file once it was rotated
+    int partial; // the last row didn't see its '\n' yet
+    int moved;   // the name refers to no file, look again later
+    int more;    // there is more to read right away
+} followState;
+
+// An open file: its rows and everything that goes with them. The windows
+// showing the same file share it
+typedef struct editorBuffer {
+    int num_rows;    // number of rows of the file
+    rowLeaf *rows;   // root of the row tree, see `rowLeaf`
+    rowLeaf *rows_head, *rows_tail; // first and last leaves
+    // rows [0, hl_ready) have an up-to-date `hl_open_comment` (and `hl`, if
+    // they have a view), rows after it are highlighted when they are shown
+    int hl_ready;
+    // sorted indices of rows below hl_ready whose `hl` may be out of date
+    // because the row above them changed its `hl_open_comment`, see
+    // editorSyntaxPropagate()
+    int *hl_stale;
+    int hl_stale_len;
+    int hl_stale_cap;
+    // version_clock at the last change of the syntax, `hl` computed before
+    // it is meaningless
+    unsigned int hl_epoch;
+    // read-only mapping of the opened file, rows that have not been edited yet
+    // point straight into it instead of owning a copy of their characters
+    char *map;
+    size_t map_len;
+    // bytes the mapping was made for, `map_len` is less once the file was
+    // truncated, see editorMapShrunk()
+    size_t map_mapped;
+    int map_fd; // the file that is mapped, -1 if none
+    int dirty; // indicates the number of changes
+    // the bytes of the file when it was read or last saved
+    off_t file_size;
+    // the save running in the background, NULL if none. Saving again or
+    // quitting meanwhile waits for it, see editorSaveStart()
+    saveJob *save_job;
+    int save_threaded; // whether `save_thread` runs it
+    pthread_t save_thread;
+    int save_again; // Ctrl-W was pressed during the save
+    int save_shown; // the percentage of it the status bar shows
+    char *file_name;
+    searchIndex search;
+    undoLog undo;
+    struct editorSyntax *syntax;
+    followState follow;
+    // what the file was when it was opened, for its cache. `cache_wanted` is
+    // set while a cache should be written, see editorCacheIdle()
+    cacheHeader cache;
+    int cache_wanted;
+    // where the cursor was when the buffer was last left, editorShowBuffer()
+    // puts it back there
+    int cx, cy, row_off, col_off;
+} editorBuffer;
+
+// A part of the screen showing a buffer: `screen_rows` rows of it from
+// screen line `top` on, and a status bar below them. The windows are stacked
+// on top of each other and split the screen evenly, see editorLayoutWindows()
+typedef struct editorWindow {
+    editorBuffer *buf;
     // keep track of the cursor's x and y position in the file
     int cx, cy;
-    int rx;      // an index into the render field
+    int rx;      // the screen column of the cursor in its row
     int row_off; // row offset, refers to which row at the top of the screen
     int col_off; // col offset, refers to which column at the left of the screen
-    int screen_rows; // number of rows the screen can display
+    int top;
+    int screen_rows; // number of rows the window can display
+    // the rows that may have a `view`, see editorKeepRows()
+    int view_from, view_to;
+} editorWindow;
+
+#if KILO_PROFILE
+// the parts of the editor that are timed, see editorProfileEnd()
+enum profileSpan {
+    PROFILE_KEY,    // editorProcessKeypress()
+    PROFILE_SYNTAX, // editorUpdateSyntax()
+    PROFILE_DRAW,   // editorRefreshScreen()
+    PROFILE_SPANS
+};
+
+// What went on since the last frame: the time spent in each span and the
+// calls of the functions that go to the kernel or to the allocator. The
+// counts are taken by all threads, the times only by the main thread. At the
+// end of every frame they become `last`, which the overlay shows, and they
+// are written to the trace as well
+typedef struct editorProfile {
+    long long spent[PROFILE_SPANS]; // nanoseconds
+    int calls[PROFILE_SPANS];
+    unsigned long long reads;  // read() and pread()
+    unsigned long long writes; // write() and writev()
+    unsigned long long bytes;  // that they wrote
+    unsigned long long allocs; // malloc(), calloc(), realloc() and strdup()
+    struct {
+        long long spent[PROFILE_SPANS];
+        int calls[PROFILE_SPANS];
+        unsigned long long reads, writes, bytes, allocs;
+    } last;
+    int shown; // Ctrl-P shows the overlay
+    // the Chrome trace (JSON array format) KILO_TRACE names, NULL if none,
+    // with the time it started and the events in it so far
+    FILE *trace;
+    long long trace_start;
+    long long trace_events;
+} editorProfile;
+#endif
+
+struct editorConfig {
+    // the buffer and the window the keys go to. Everything that works with
+    // rows works with those of E.buf, which is what E.win shows, except while
+    // the other windows are drawn
+    editorBuffer *buf;
+    editorWindow *win;
+    editorBuffer **bufs; // all open files
+    int num_bufs, bufs_cap;
+    editorWindow wins[KILO_WINDOWS_MAX];
+    int num_wins;
+    // rows of the screen above the last status bar and the message bar
+    int screen_rows;
     int screen_cols; // number of cols the screen can display
-    int num_rows;    // number of rows of the file
-    erow *rows;
-    int dirty; // indicates the number of changes
-    char *file_name;
+    // A frame is drawn into `screen_back` first (the rows of the file, the
+    // status bar and the message bar), `screen_front` holds what the terminal
+    // shows, so only the cells that differ are sent. Both are `screen_h`
+    // lines of `screen_w` cells
+    screenCell *screen_back;
+    screenCell *screen_front;
+    int screen_w, screen_h;
+    int front_valid; // 0 until the terminal shows `screen_front`
+    // where the cursor was put at the end of the last frame
+    int cursor_y, cursor_x;
+    // the bytes of a frame. It is kept from frame to frame, and sized so that
+    // even a full redraw in the worst case fits without growing it
+    struct abuf frame;
+    // the SGR sequence that switches the terminal to each cell attribute
+    char sgr[256][CELL_SGR_MAX];
+    unsigned char sgr_len[256];
+    // what the terminal told about scrolling, see editorTerminalReply()
+    int term_level;
+    // when editorQuerySize() asked the terminal for its size, 0 if no such
+    // question is out
+    long long size_query_at;
+    // input read from the terminal, [input_at, input_len) is not handled yet
+    char input[KILO_INPUT_BUF];
+    int input_len, input_at;
+    // Everything that wakes the editor up, other than input, writes a byte to
+    // this pipe: the SIGWINCH handler (which also sets `winch`) and the
+    // highlighting thread when it finishes a job. See editorWaitEvent()
+    int wake_pipe[2];
+    volatile sig_atomic_t winch;
+    // hashes of the lines of `screen_back` and `screen_front`, see
+    // editorScrollScreen()
+    unsigned long long *line_hash_back, *line_hash_front;
+    // where rows without a view are rendered and highlighted
+    hlScratch hl_scratch;
+    // all syntaxes by the file names they match, `syntax_mask` + 1 slots
+    syntaxMatch *syntax_slots;
+    unsigned int syntax_mask;
+    int syntax_used;
+    // where the cache files go, NULL if nowhere, see editorCacheInit()
+    char *cache_dir;
+    // source of the row versions, see `erow`
+    unsigned int version_clock;
+    // the highlighting thread and the job it works on. `hl_job` and
+    // `hl_job_state` are guarded by `hl_lock`, which neither thread holds for
+    // long
+    int hl_thread_on;
+    pthread_t hl_thread;
+    pthread_mutex_t hl_lock;
+    pthread_cond_t hl_cond;
+    hlJob *hl_job;
+    int hl_job_state;
+    // the thread pool for searching and replacing, the main thread is worker
+    // 0 of `pool_size`. The workers are started on the first task
+    int pool_size;
+    int pool_started;
+    pthread_t pool_threads[KILO_POOL_MAX];
+    pthread_mutex_t pool_lock;
+    pthread_cond_t pool_cond; // a task was posted
+    pthread_cond_t pool_idle; // the last worker left the task
+    poolTask *pool_task;      // NULL if none
+    unsigned int pool_generation; // counts the posted tasks
+    // a mapping that was released while the highlighting thread could still
+    // be reading from it, unmapped once the thread's job is back
+    char *map_retired;
+    size_t map_retired_len;
+    long page_size; // for the SIGBUS handler, which can't ask for it
+    int save_quit;  // Ctrl-Q was pressed during the saves
+#if KILO_PROFILE
+    editorProfile profile;
+#endif
+    // the inotify instance watching the followed files, -1 if none. Rows
+    // appended to them are drawn at most once per KILO_FOLLOW_FRAME_MS, from
+    // `follow_frame_at` on, `follow_pending` tells that some are not yet
+    int inotify_fd;
+    long long follow_frame_at;
+    int follow_pending;
     char statusmsg[80];
     time_t statusmsg_time;
-    struct editorSyntax *syntax;
     struct termios orig_termios;
 };
 
 struct editorConfig E;
 
+// the columns each character of the first two planes of Unicode takes, two
+// bits each, in blocks of 128 characters that are stored once however often
+// they come up. The tables themselves are at the end of this file
+#define CHAR_WIDTH_BLOCKS 202
+static const unsigned char charWidthIndex[0x20000 >> 7];
+static const unsigned char charWidthBlocks[CHAR_WIDTH_BLOCKS * 32];
+
 /*** file types ***/
 
+// The file types that are built in. More of them can be defined in a file,
+// see editorSyntaxLoad(). The patterns are whole file names or, starting with
+// a '.', extensions
+
 char *C_HL_extensions[] = {".c", ".h", ".cpp", NULL};
 // terminate the second type of keywords with a pipe character
 char *C_HL_keywords[] = {"switch",    "if",      "while",   "for",    "break",
@@ -119,10 +844,81 @@ char *C_HL_keywords[] = {"switch",    "if",      "while",   "for",    "break",
                          "int|",      "long|",   "double|", "float|", "char|",
                          "unsigned|", "signed|", "void|",   NULL};
 
+char *PY_HL_extensions[] = {".py", NULL};
+char *PY_HL_keywords[] = {
+    "and",    "as",     "assert", "break",  "class",   "continue", "def",
+    "del",    "elif",   "else",   "except", "finally", "for",      "from",
+    "global", "if",     "import", "in",     "is",      "lambda",   "nonlocal",
+    "not",    "or",     "pass",   "raise",  "return",  "try",      "while",
+    "with",   "yield",  "None|",  "True|",  "False|",  "int|",     "float|",
+    "str|",   "bytes|", "list|",  "dict|",  "set|",    "tuple|",   "bool|",
+    "self|",  NULL};
+
+char *SH_HL_extensions[] = {".sh", ".bash", ".zsh", NULL};
+char *SH_HL_keywords[] = {
+    "if",     "then",  "else", "elif",  "fi",   "case",     "esac",   "for",
+    "while",  "until", "do",   "done",  "in",   "function", "return", "local",
+    "export", "echo|", "cd|",  "test|", "set|", "unset|",   "read|",  "exit|",
+    NULL};
+
+char *JS_HL_extensions[] = {".js", ".mjs", ".ts", NULL};
+char *JS_HL_keywords[] = {
+    "break",    "case",       "catch",  "class",    "const",      "continue",
+    "debugger", "default",    "delete", "do",       "else",       "export",
+    "extends",  "finally",    "for",    "function", "if",         "import",
+    "in",       "instanceof", "let",    "new",      "return",     "super",
+    "switch",   "this",       "throw",  "try",      "typeof",     "var",
+    "void",     "while",      "with",   "yield",    "async",      "await",
+    "of",       "true|",      "false|", "null|",    "undefined|", "number|",
+    "string|",  "boolean|",   NULL};
+
+char *GO_HL_extensions[] = {".go", NULL};
+char *GO_HL_keywords[] = {
+    "break",    "case",   "chan",        "const",     "continue", "default",
+    "defer",    "else",   "fallthrough", "for",       "func",     "go",
+    "goto",     "if",     "import",      "interface", "map",      "package",
+    "range",    "return", "select",      "struct",    "switch",   "type",
+    "var",      "bool|",  "byte|",       "error|",    "float32|", "float64|",
+    "int|",     "int8|",  "int16|",      "int32|",    "int64|",   "rune|",
+    "string|",  "uint|",  "uint8|",      "uint16|",   "uint32|",  "uint64|",
+    "uintptr|", "nil|",   "true|",       "false|",    NULL};
+
+char *RS_HL_extensions[] = {".rs", NULL};
+char *RS_HL_keywords[] = {
+    "as",      "break",  "const", "continue", "crate",   "else",   "enum",
+    "extern",  "fn",     "for",   "if",       "impl",    "in",     "let",
+    "loop",    "match",  "mod",   "move",     "mut",     "pub",    "ref",
+    "return",  "self",   "Self",  "static",   "struct",  "super",  "trait",
+    "type",    "unsafe", "use",   "where",    "while",   "async",  "await",
+    "dyn",     "i8|",    "i16|",  "i32|",     "i64|",    "i128|",  "isize|",
+    "u8|",     "u16|",   "u32|",  "u64|",     "u128|",   "usize|", "f32|",
+    "f64|",    "bool|",  "char|", "str|",     "String|", "Vec|",   "Option|",
+    "Result|", "Some|",  "None|", "Ok|",      "Err|",    "true|",  "false|",
+    NULL};
+
+char *MK_HL_extensions[] = {"Makefile", "makefile", "GNUmakefile", ".mk",
+                            NULL};
+char *MK_HL_keywords[] = {
+    "ifeq",   "ifneq", "ifdef",  "ifndef",   "else", "endif", "include",
+    "define", "endef", "export", "override", NULL};
+
 // highlight database
 struct editorSyntax HLDB[] = {
     {"c", C_HL_extensions, C_HL_keywords, "//", "/*", "*/",
-     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, NULL, NULL},
+    {"python", PY_HL_extensions, PY_HL_keywords, "#", NULL, NULL,
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, NULL, NULL},
+    {"sh", SH_HL_extensions, SH_HL_keywords, "#", NULL, NULL,
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, NULL, NULL},
+    {"javascript", JS_HL_extensions, JS_HL_keywords, "//", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, "\"'`", NULL},
+    {"go", GO_HL_extensions, GO_HL_keywords, "//", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, "\"'`", NULL},
+    // ' also starts a lifetime, so only " quotes
+    {"rust", RS_HL_extensions, RS_HL_keywords, "//", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS, "\"", NULL},
+    {"make", MK_HL_extensions, MK_HL_keywords, "#", NULL, NULL, 0, NULL,
+     NULL},
 };
 
 // length of HLDB array
@@ -132,7 +928,201 @@ struct editorSyntax HLDB[] = {
 
 void editorSetStatusMessage(const char *fmt, ...);
 void editorRefreshScreen();
-char *editorPrompt(char *prompt, void (*callback)(char *, int));
+char *editorPrompt(char *prompt, void (*callback)(char *, int),
+                   int allow_empty);
+void editorSyntaxPropagate(int at);
+int editorSyntaxIdle();
+int editorCacheReady();
+void editorCacheIdle();
+void editorCacheKey(char *map, struct stat *st);
+int editorCacheLoad(char *map, size_t map_len);
+int editorMapCheck();
+void editorMapFault(int sig, siginfo_t *info, void *context);
+colMap *editorColsBuild(const char *chars, int size);
+int editorRenderLen(int size, colMap *cols);
+int editorRenderText(const char *chars, int size, colMap *cols, char *render);
+int abReserve(struct abuf *ab, int len);
+void abAppend(struct abuf *ab, const char *s, int len);
+void abFree(struct abuf *ab);
+int editorHlThreadDone();
+void editorWaitEvent();
+void editorTerminalReply(const char *params, char final);
+int editorSaveIdle();
+int editorSaveTimeout();
+void editorSaveStart();
+void editorQuit();
+void editorLayoutWindows();
+int editorBuffersSaving();
+int editorBuffersDirty();
+int editorFollowIdle();
+int editorFollowTimeout();
+
+/*** profiling ***/
+
+#if KILO_PROFILE
+// nanoseconds since some fixed point in the past
+long long editorProfileNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// any thread may count, even the SIGWINCH handler (through write())
+void editorProfileCount(unsigned long long *counter, unsigned long long n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+// The functions that are counted, and the macros below them that make every
+// call further down go through them
+void *editorProfileMalloc(size_t size) {
+    editorProfileCount(&E.profile.allocs, 1);
+    return malloc(size);
+}
+
+void *editorProfileCalloc(size_t n, size_t size) {
+    editorProfileCount(&E.profile.allocs, 1);
+    return calloc(n, size);
+}
+
+void *editorProfileRealloc(void *p, size_t size) {
+    editorProfileCount(&E.profile.allocs, 1);
+    return realloc(p, size);
+}
+
+char *editorProfileStrdup(const char *s) {
+    editorProfileCount(&E.profile.allocs, 1);
+    return strdup(s);
+}
+
+ssize_t editorProfileRead(int fd, void *buf, size_t len) {
+    editorProfileCount(&E.profile.reads, 1);
+    return read(fd, buf, len);
+}
+
+ssize_t editorProfilePread(int fd, void *buf, size_t len, off_t off) {
+    editorProfileCount(&E.profile.reads, 1);
+    return pread(fd, buf, len, off);
+}
+
+ssize_t editorProfileWrite(int fd, const void *buf, size_t len) {
+    ssize_t n = write(fd, buf, len);
+    editorProfileCount(&E.profile.writes, 1);
+    if (n > 0) {
+        editorProfileCount(&E.profile.bytes, n);
+    }
+    return n;
+}
+
+ssize_t editorProfileWritev(int fd, const struct iovec *iov, int count) {
+    ssize_t n = writev(fd, iov, count);
+    editorProfileCount(&E.profile.writes, 1);
+    if (n > 0) {
+        editorProfileCount(&E.profile.bytes, n);
+    }
+    return n;
+}
+
+#define malloc(size) editorProfileMalloc(size)
+#define calloc(n, size) editorProfileCalloc(n, size)
+#define realloc(p, size) editorProfileRealloc(p, size)
+#define strdup(s) editorProfileStrdup(s)
+#define read(fd, buf, len) editorProfileRead(fd, buf, len)
+#define pread(fd, buf, len, off) editorProfilePread(fd, buf, len, off)
+#define write(fd, buf, len) editorProfileWrite(fd, buf, len)
+#define writev(fd, iov, count) editorProfileWritev(fd, iov, count)
+
+// start an event of the trace, the caller writes the rest of it
+void editorTraceEvent(const char *name, const char *ph, long long at) {
+    editorProfile *P = &E.profile;
+    fprintf(P->trace,
+            "%s{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":1,\"tid\":1,"
+            "\"ts\":%.3f",
+            P->trace_events++ ? ",\n" : "", name, ph,
+            (at - P->trace_start) / 1000.0);
+}
+
+void editorTraceClose() {
+    fprintf(E.profile.trace, "\n]\n");
+    fclose(E.profile.trace);
+}
+
+// open the trace KILO_TRACE names, if it does
+void editorProfileInit() {
+    char *path = getenv("KILO_TRACE");
+    if (path == NULL) {
+        return;
+    }
+    E.profile.trace = fopen(path, "w");
+    // the terminal is not in raw mode yet
+    if (E.profile.trace == NULL) {
+        perror(path);
+        exit(1);
+    }
+    E.profile.trace_start = editorProfileNow();
+    fprintf(E.profile.trace, "[\n");
+    atexit(editorTraceClose);
+}
+
+// the span that began at `start` ends. Highlighting takes single rows at a
+// time, much too many to trace one by one, it goes to the trace counted for
+// each frame
+void editorProfileEnd(int span, long long start) {
+    static const char *names[PROFILE_SPANS] = {
+        "editorProcessKeypress", "editorUpdateSyntax", "editorRefreshScreen"};
+    editorProfile *P = &E.profile;
+    long long now = editorProfileNow();
+    P->spent[span] += now - start;
+    P->calls[span]++;
+    if (span == PROFILE_KEY) {
+        // the overlay shows the last key, not all since the last frame
+        P->spent[span] = now - start;
+        P->calls[span] = 1;
+    }
+    if (P->trace && span != PROFILE_SYNTAX) {
+        editorTraceEvent(names[span], "X", start);
+        fprintf(P->trace, ",\"dur\":%.3f}", (now - start) / 1000.0);
+    }
+}
+
+unsigned long long editorProfileTake(unsigned long long *counter) {
+    return __atomic_exchange_n(counter, 0, __ATOMIC_RELAXED);
+}
+
+// a frame is done: what went on since the last one is what the overlay
+// shows next, and what the counters of the trace show
+void editorProfileFrame() {
+    editorProfile *P = &E.profile;
+    memcpy(P->last.spent, P->spent, sizeof(P->spent));
+    memcpy(P->last.calls, P->calls, sizeof(P->calls));
+    memset(P->spent, 0, sizeof(P->spent));
+    memset(P->calls, 0, sizeof(P->calls));
+    P->last.reads = editorProfileTake(&P->reads);
+    P->last.writes = editorProfileTake(&P->writes);
+    P->last.bytes = editorProfileTake(&P->bytes);
+    P->last.allocs = editorProfileTake(&P->allocs);
+    if (P->trace == NULL) {
+        return;
+    }
+    long long now = editorProfileNow();
+    editorTraceEvent("syntax", "C", now);
+    fprintf(P->trace, ",\"args\":{\"ms\":%.3f,\"rows\":%d}}",
+            P->last.spent[PROFILE_SYNTAX] / 1e6, P->last.calls[PROFILE_SYNTAX]);
+    editorTraceEvent("bytes written", "C", now);
+    fprintf(P->trace, ",\"args\":{\"bytes\":%llu}}", P->last.bytes);
+    editorTraceEvent("calls", "C", now);
+    fprintf(P->trace,
+            ",\"args\":{\"reads\":%llu,\"writes\":%llu,\"allocs\":%llu}}",
+            P->last.reads, P->last.writes, P->last.allocs);
+    // what is in the trace stays there, even if the editor is killed
+    fflush(P->trace);
+}
+
+#define PROFILE_BEGIN(start) long long start = editorProfileNow()
+#define PROFILE_END(span, start) editorProfileEnd(span, start)
+#else
+#define PROFILE_BEGIN(start)
+#define PROFILE_END(span, start)
+#endif
 
 /*** terminal ***/
 
@@ -148,6 +1138,8 @@ void die(const char *s) {
 }
 
 void disableRawMode() {
+    // \x1b[?2004l: turn bracketed paste off again
+    write(STDOUT_FILENO, "\x1b[?2004l", 8);
     // set the terminal attricutes to its original value
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_termios) == -1) {
         die("tcsetattr");
@@ -194,8 +1186,10 @@ void enableRawMode() {
     //  can return
     // VTIME: sets the maximum amount of time to wait before `read()` returns,
     //  which is in tenths of a second (100ms)
+    // Both are 0, so `read()` returns at once with whatever there is. Waiting
+    // is left to poll(), see editorWaitEvent()
     raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;
+    raw.c_cc[VTIME] = 0;
 
     // SA means `set attributes`, TCSAFLUSH specifies when to apply the change
     // FLUSH:
@@ -207,18 +1201,59 @@ void enableRawMode() {
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
         die("tcsetattr");
     }
+    // \x1b[?2004h: bracketed paste, the terminal sends pasted text between
+    // \x1b[200~ and \x1b[201~ so it can be inserted all at once
+    write(STDOUT_FILENO, "\x1b[?2004h", 8);
+}
+
+// wait up to `timeout` milliseconds (-1 for as long as it takes) for input,
+// and return whether there is some
+int editorPollInput(int timeout) {
+    struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    int n;
+    while ((n = poll(&fd, 1, timeout)) == -1 && errno == EINTR) {
+    }
+    return n > 0;
+}
+
+// read() whatever the terminal has sent into the input buffer, in one go, so
+// a burst of keys (or a paste) costs one system call, not one per byte
+int editorFillInput() {
+    int nread = read(STDIN_FILENO, E.input, sizeof(E.input));
+    if (nread == -1 && errno != EAGAIN && errno != EINTR) {
+        die("read");
+    }
+    if (nread > 0) {
+        E.input_len = nread;
+        E.input_at = 0;
+    }
+    return nread;
+}
+
+// take the next byte of input, for the bytes that follow the first one of a
+// key. The rest of an escape sequence comes right after its first byte, so
+// this waits at most KILO_ESC_TIMEOUT for more. Returns 0 if nothing came
+int editorReadByte(char *c) {
+    if (E.input_at == E.input_len) {
+        if (!editorPollInput(KILO_ESC_TIMEOUT) || editorFillInput() <= 0) {
+            return 0;
+        }
+    }
+    *c = E.input[E.input_at++];
+    return 1;
 }
 
+// whether input has been read that isn't handled yet
+int editorInputPending() { return E.input_at < E.input_len; }
+
 // wait for one keypress, and return it
 // later, we will expand it to handle escape sequences
 int editorReadKey() {
-    int nread;
     char c;
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-        if (nread == -1 && errno != EAGAIN) {
-            die("read");
-        }
+    while (!editorInputPending()) {
+        editorWaitEvent();
     }
+    editorReadByte(&c);
     // If we read an escape character, we immediately read two more bytes into
     // the seq buffer. If either of these reads time out, then we assume the
     // user just pressed the Escape key and return that. Otherwise we look to
@@ -227,18 +1262,39 @@ int editorReadKey() {
         char seq[3];
 
         // try to read two more bytes, if time out (no more bytes, return \x1b)
-        if (read(STDIN_FILENO, &seq[0], 1) != 1)
+        if (editorReadByte(&seq[0]) != 1)
             return '\x1b';
-        if (read(STDIN_FILENO, &seq[1], 1) != 1)
+        if (editorReadByte(&seq[1]) != 1)
             return '\x1b';
 
         // Home key could be sent as \x1b[1~, \x1b[7~, \x1b[H, \x1b0H
         // End key could be sent as \x1b[4~, \x1b[8~, \x1b[F, \x1b0F
         if (seq[0] == '[') {
-            if (seq[1] >= '0' && seq[1] <= '9') {
-                if (read(STDIN_FILENO, &seq[2], 1) != 1)
-                    return '\x1b';
-                if (seq[2] == '~') {
+            if ((seq[1] >= '0' && seq[1] <= '9') || seq[1] == '?') {
+                // read the parameters up to the final byte, like `5` in
+                // \x1b[5~
+                char params[32];
+                unsigned int len = 0;
+                params[len++] = seq[1];
+                while (1) {
+                    if (editorReadByte(&seq[2]) != 1)
+                        return '\x1b';
+                    if (seq[2] >= 0x40 && seq[2] <= 0x7e)
+                        break;
+                    if (len < sizeof(params) - 1)
+                        params[len++] = seq[2];
+                }
+                params[len] = '\0';
+                if (seq[2] == 'c' || seq[2] == 'R') {
+                    editorTerminalReply(params, seq[2]);
+                }
+                // \x1b[200~ comes before pasted text
+                if (seq[2] == '~' && strcmp(params, "200") == 0) {
+                    return PASTE_START;
+                }
+                // keys with modifiers and answers from the terminal are
+                // dropped below
+                if (seq[2] == '~' && len == 1) {
                     switch (seq[1]) {
                     case '1':
                         return HOME_KEY;
@@ -256,6 +1312,7 @@ int editorReadKey() {
                         return END_KEY;
                     }
                 }
+                return KEY_NONE;
             } else {
                 switch (seq[1]) {
                 case 'A':
@@ -283,358 +1340,2275 @@ int editorReadKey() {
 
         return '\x1b';
     } else {
-        return c;
+        // the bytes of UTF-8 characters come one by one, as 128-255
+        return (unsigned char)c;
     }
 }
 
-int getCursorPosition(int *rows, int *cols) {
-    char buf[32];
-    unsigned int i = 0;
-    // `n` command can be used to query the terminal for status information
-    // argument 6 to ask for the cursor position
-    if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4) {
-        return -1;
-    }
+// milliseconds since some fixed point in the past
+long long editorNowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-    while (i < sizeof(buf) - 1) {
-        if (read(STDIN_FILENO, &buf[i], 1) != 1)
-            break;
-        if (buf[i] == 'R')
-            break;
-        i++;
+// take `rows` x `cols` as the size of the terminal
+void editorSetScreenSize(int rows, int cols) {
+    if (rows < 3 || cols < 1) {
+        return;
     }
+    // make room for a two-line status (file name, cursor position, etc.) and
+    //  message bar at the bottom of the screen
+    E.screen_rows = rows - 2;
+    E.screen_cols = cols;
+    editorLayoutWindows();
+    // the terminal may have moved or wrapped what it showed, so the next
+    // frame is drawn in full
+    E.front_valid = 0;
+}
 
-    buf[i] = '\0';
+// Ask the terminal where the cursor is once it's moved as far right and down
+// as it goes: the answer is the size of the screen. There is no simple "move
+// the cursor to the bottom-right corner" command, `C` moves the cursor to the
+// right, `B` down, and they are documented to stop at the edge of the screen.
+// The answer is read with the input, see editorTerminalReply(), nothing waits
+// for it and editorWaitEvent() gives up on it after KILO_QUERY_TIMEOUT
+void editorQuerySize() {
+    write(STDOUT_FILENO, "\x1b[999C\x1b[999B\x1b[6n", 16);
+    E.size_query_at = editorNowMs();
+    // the next frame has to put the cursor back
+    E.cursor_y = -1;
+}
 
-    if (buf[0] != '\x1b' || buf[1] != '[') {
-        return -1;
+// Ask the terminal what it is (Primary Device Attributes). Until the answer
+// comes in with the input, the screen is drawn as for a terminal that can't
+// scroll parts of it
+void editorQueryTerminal() {
+    E.term_level = 0;
+    write(STDOUT_FILENO, "\x1b[c", 3);
+}
+
+// handle what the terminal answered to a query, which editorReadKey() reads
+// like a key: the CSI parameters `params` and the final byte `final`
+void editorTerminalReply(const char *params, char final) {
+    // \x1b[?62;1;6c: the first number is the class of the terminal, VT100s
+    // have scroll regions and VT220s (62) and later can also scroll them with
+    // CSI S and CSI T
+    if (final == 'c' && params[0] == '?') {
+        E.term_level = atoi(&params[1]) >= 62 ? 2 : 1;
     }
-    // sscanf(const char *restrict s, const char *restrict format, ...);
-    if (sscanf(&buf[2], "%d;%d", rows, cols) != 2) {
-        return -1;
+    // \x1b[24;80R: the cursor position. Some keys end in R as well (Shift-F3
+    // can be \x1b[1;2R), so this is only taken while editorQuerySize() waits
+    int rows, cols;
+    if (final == 'R' && E.size_query_at &&
+        sscanf(params, "%d;%d", &rows, &cols) == 2) {
+        E.size_query_at = 0;
+        editorSetScreenSize(rows, cols);
     }
-
-    return 0;
 }
 
-int getWindowSize(int *rows, int *cols) {
+// find out the size of the terminal. ioctl() tells right away, but it isn't
+// guaranteed to work on all systems, otherwise the terminal is asked
+void editorUpdateWindowSize() {
     struct winsize ws;
-
-    // ioctl isn't guaranteed to be able to request the window size on all
-    //  systems, so we have to provide a fallback method of getting the window
-    //  size
     if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
-        // There is no simple "move the cursor to the bottom-right corner"
-        // command `C` command moves the cursor to the right, `B` ... down.
-        //  And they are specifically documented to stop the cursor from going
-        //  past the edge of the screen.
-        if (write(STDOUT_FILENO, "\x1b[999C\x1b[999B", 12) != 12) {
-            return -1;
-        }
-
-        return getCursorPosition(rows, cols);
+        editorQuerySize();
     } else {
-        *cols = ws.ws_col;
-        *rows = ws.ws_row;
-        return 0;
+        editorSetScreenSize(ws.ws_row, ws.ws_col);
     }
 }
 
-/*** syntax highlighting ***/
-
-int is_separator(int c) {
-    // strchr() locates the first occurrence of c in the string pointed to by s
-    return isspace(c) || c == '\0' || strchr("\",.()+-/*=~%<>[];", c) != NULL;
+// write a byte to the wake pipe, so editorWaitEvent() returns. Called from
+// the SIGWINCH handler and the highlighting thread
+void editorWake() {
+    int saved_errno = errno;
+    write(E.wake_pipe[1], "", 1);
+    errno = saved_errno;
 }
 
-void editorUpdateSyntax(erow *row) {
-    row->hl = realloc(row->hl, row->rsize);
-    memset(row->hl, HL_NORMAL, row->rsize);
+void editorHandleSigwinch(int sig) {
+    (void)sig;
+    E.winch = 1;
+    editorWake();
+}
 
-    if (E.syntax == NULL) {
-        return;
+// set up the wake pipe, the SIGWINCH handler and the SIGBUS one
+void editorEventsInit() {
+    if (pipe(E.wake_pipe) == -1) {
+        die("pipe");
     }
+    for (int i = 0; i < 2; i++) {
+        fcntl(E.wake_pipe[i], F_SETFL, O_NONBLOCK);
+        fcntl(E.wake_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    E.winch = 0;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = editorHandleSigwinch;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, NULL);
+    E.page_size = sysconf(_SC_PAGESIZE);
+    sa.sa_handler = NULL;
+    sa.sa_sigaction = editorMapFault;
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGBUS, &sa, NULL);
+}
 
-    char **keywords = E.syntax->keywords;
-    char *slcs = E.syntax->single_line_comment_start;
-    char *mlcs = E.syntax->multi_line_comment_start;
-    char *mlce = E.syntax->multi_line_comment_end;
-
-    int slcs_len = slcs ? strlen(slcs) : 0;
-    int mlcs_len = mlcs ? strlen(mlcs) : 0;
-    int mlce_len = mlce ? strlen(mlce) : 0;
-
-    int prev_sep = 1;
-    int in_string = 0;
-    // true if the previous row has an unclosed multi-line comment
-    int in_comment = (row->index > 0 && E.rows[row->index - 1].hl_open_comment);
+// milliseconds until the status message runs out, or -1 if none is shown
+int editorStatusMsgTimeout() {
+    if (E.statusmsg[0] == '\0') {
+        return -1;
+    }
+    long left = (long)(E.statusmsg_time + KILO_MSG_SECS - time(NULL)) * 1000;
+    return left > 0 ? (int)left : 0;
+}
 
-    int i = 0;
-    while (i < row->rsize) {
-        char c = row->render[i];
-        unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
+// milliseconds until editorQuerySize() stops waiting, or -1 if it doesn't
+int editorSizeQueryTimeout() {
+    if (E.size_query_at == 0) {
+        return -1;
+    }
+    long long left = E.size_query_at + KILO_QUERY_TIMEOUT - editorNowMs();
+    return left > 0 ? (int)left : 0;
+}
 
-        // single-line comments should not be recognized inside multi-line
-        // comments
-        if (slcs_len && !in_string && !in_comment) {
-            // compares not more than slcs_len characters
-            if (!strncmp(&row->render[i], slcs, slcs_len)) {
-                memset(&row->hl[i], HL_COMMENT, row->rsize - i);
-                break;
-            }
+// Sleep until something needs the editor, and take care of it: input (which
+// is read into the input buffer), a resize, the highlighting thread finishing
+// a job, a save finishing, a followed file growing, the status message running
+// out or the terminal not answering a size query. Nothing wakes the editor up
+// periodically, except to show how far a save got or to look at a followed
+// file inotify can't watch, and only while there are stale rows left to catch
+// up on (or a followed file to read on, or a cache to write) does it not sleep
+// at all
+void editorWaitEvent() {
+    int timeout = E.buf->hl_stale_len > 0 || editorCacheReady()
+                      ? 0
+                      : editorStatusMsgTimeout();
+    int query = editorSizeQueryTimeout();
+    if (query >= 0 && (timeout < 0 || query < timeout)) {
+        timeout = query;
+    }
+    int save = editorSaveTimeout();
+    if (save >= 0 && (timeout < 0 || save < timeout)) {
+        timeout = save;
+    }
+    int follow = editorFollowTimeout();
+    if (follow >= 0 && (timeout < 0 || follow < timeout)) {
+        timeout = follow;
+    }
+    // poll() skips the inotify instance while there is none
+    struct pollfd fds[3] = {{STDIN_FILENO, POLLIN, 0},
+                            {E.wake_pipe[0], POLLIN, 0},
+                            {E.inotify_fd, POLLIN, 0}};
+    if (poll(fds, 3, timeout) == -1) {
+        if (errno != EINTR) {
+            die("poll");
         }
+        fds[0].revents = fds[1].revents = fds[2].revents = 0;
+    }
 
-        if (mlcs_len && mlce_len && !in_string) {
-            if (in_comment) {
-                row->hl[i] = HL_MLCOMMENT;
-                if (!strncmp(&row->render[i], mlce, mlce_len)) {
-                    memset(&row->hl[i], HL_MLCOMMENT, mlce_len);
-                    i += mlce_len;
-                    in_comment = 0;
-                    prev_sep = 1;
-                    continue;
-                } else {
-                    i++;
-                    continue;
-                }
-            } else if (!strncmp(&row->render[i], mlcs, mlcs_len)) {
-                memset(&row->hl[i], HL_MLCOMMENT, mlcs_len);
-                i += mlcs_len;
-                in_comment = 1;
-                continue;
-            }
+    if (fds[1].revents & POLLIN) {
+        char drain[64];
+        while (read(E.wake_pipe[0], drain, sizeof(drain)) > 0) {
         }
-
-        if (E.syntax->flags & HL_HIGHLIGHT_STRINGS) {
-            if (in_string) {
-                row->hl[i] = HL_STRING;
-                // take escaped quotes into account (\' or \")
-                if (c == '\\' && i + 1 < row->rsize) {
-                    row->hl[i + 1] = HL_STRING;
-                    i += 2;
-                    continue;
-                }
-                if (c == in_string) {
-                    in_string = 0;
-                }
-                i++;
-                prev_sep = 1;
-                continue;
-            } else {
-                // highlight both double-quoted and single-quoted strings
-                if (c == '"' || c == '\'') {
-                    in_string = c;
-                    row->hl[i] = HL_STRING;
-                    i++;
-                    continue;
-                }
-            }
+    }
+    // which file changed doesn't matter, editorFollowIdle() looks at all of
+    // them
+    if (fds[2].revents & POLLIN) {
+        char drain[4096];
+        while (read(E.inotify_fd, drain, sizeof(drain)) > 0) {
         }
-
-        if (E.syntax->flags & HL_HIGHLIGHT_NUMBERS) {
-            // avoid highlighting "32" in "int32_t"
-            if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) ||
-                (c == '.' && prev_hl == HL_NUMBER)) {
-                row->hl[i] = HL_NUMBER;
-                i++;
-                prev_sep = 0;
-                continue;
-            }
+    }
+    int redraw = 0;
+    if (E.winch) {
+        E.winch = 0;
+        editorUpdateWindowSize();
+        redraw = 1;
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+        // the terminal is gone
+        if (editorFillInput() == 0 && !(fds[0].revents & POLLIN)) {
+            exit(1);
         }
-
-        if (prev_sep) {
-            int j;
-            for (j = 0; keywords[j]; j++) {
-                int klen = strlen(keywords[j]);
-                int kw2 = keywords[j][klen - 1] == '|';
-                if (kw2) {
-                    klen--;
-                }
-
-                if (!strncmp(&row->render[i], keywords[j], klen) &&
-                    is_separator(row->render[i + klen])) {
-                    memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
-                    i += klen;
-                    break;
-                }
-            }
-            // check if the loop was broken out of
-            if (keywords[j] != NULL) {
-                prev_sep = 0;
-                continue;
-            }
+    }
+    if (!editorInputPending()) {
+        // use the pause for work nobody is waiting for, on rows that are
+        // still there
+        redraw |= editorMapCheck();
+        redraw |= editorSyntaxIdle();
+        editorCacheIdle();
+        redraw |= editorSaveIdle();
+        redraw |= editorFollowIdle();
+        if (editorStatusMsgTimeout() == 0) {
+            E.statusmsg[0] = '\0';
+            redraw = 1;
+        }
+        // the size stays what it was
+        if (editorSizeQueryTimeout() == 0) {
+            E.size_query_at = 0;
         }
-
-        prev_sep = is_separator(c);
-        i++;
     }
-
-    int changed = (row->hl_open_comment != in_comment);
-    // check whether the row ended as unclosed multi-line comment or not
-    row->hl_open_comment = in_comment;
-    if (changed && row->index + 1 < E.num_rows) {
-        editorUpdateSyntax(&E.rows[row->index + 1]);
+    if (redraw) {
+        editorRefreshScreen();
     }
 }
 
-int editorSyntaxToColor(int hl) {
-    switch (hl) {
-    case HL_COMMENT:
-    case HL_MLCOMMENT:
-        return 36;
-    case HL_KEYWORD1:
-        return 33;
-    case HL_KEYWORD2:
-        return 32;
-    case HL_STRING:
-        return 35;
-    case HL_NUMBER:
-        return 31; // foreground red
-    case HL_MATCH:
-        return 34; // foreground blue
-    default:
-        return 37; // foreground white
+/*** row storage ***/
+
+// return a capacity of at least `need` bytes. Buffers grow geometrically, so
+// a stream of small insertions only reaches the allocator every time the
+// buffer doubles in size
+int editorGrowCap(int cap, int need) {
+    if (cap < 16) {
+        cap = 16;
+    }
+    while (cap < need) {
+        cap *= 2;
     }
+    return cap;
 }
 
-void editorSelectSyntaxHighlight() {
-    E.syntax = NULL;
-    if (E.file_name == NULL) {
-        return;
-    }
+unsigned int rowLeafRandom() {
+    // xorshift, the priorities only need to look random to keep the tree
+    // balanced
+    static unsigned int x = 2463534242u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
 
-    // strrchr() locates the last occurence of c in s
-    // get a pointer to the extension part of filename
-    char *ext = strrchr(E.file_name, '.');
+int rowLeafTotal(rowLeaf *t) { return t ? t->total : 0; }
 
-    for (unsigned int i = 0; i < HLDB_ENTRIES; i++) {
-        // char *file_type, char **file_match, int flags
-        struct editorSyntax *s = &HLDB[i];
-        unsigned int j = 0;
-        while (s->file_match[j]) {
-            int is_ext = (s->file_match[j][0] == '.');
-            // strcmp() returns 0 if two given strings are equal
-            // strstr() tries to find a little string in a big string
-            if ((is_ext && ext && !strcmp(ext, s->file_match[j])) ||
-                (!is_ext && strstr(E.file_name, s->file_match[j]))) {
-                E.syntax = s;
-
-                for (int file_row = 0; file_row < E.num_rows; file_row++) {
-                    editorUpdateSyntax(&E.rows[file_row]);
-                }
+long long rowLeafTotalBytes(rowLeaf *t) { return t ? t->total_bytes : 0; }
 
-                return;
-            }
-            j++;
-        }
+void rowLeafPull(rowLeaf *t) {
+    t->total = rowLeafTotal(t->left) + t->n + rowLeafTotal(t->right);
+    t->total_bytes =
+        rowLeafTotalBytes(t->left) + t->bytes + rowLeafTotalBytes(t->right);
+}
+
+// add up the bytes of the rows of a leaf, each with its newline
+void rowLeafCount(rowLeaf *leaf) {
+    leaf->bytes = 0;
+    for (int i = 0; i < leaf->n; i++) {
+        leaf->bytes += leaf->rows[i].size + 1;
     }
 }
-/*** row operations ***/
 
-int editorRowCxToRx(erow *row, int cx) {
-    int rx = 0;
-    for (int i = 0; i < cx; i++) {
-        if (row->chars[i] == '\t') {
-            rx += (KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP);
-        }
-        rx++;
+rowLeaf *rowLeafNew() {
+    rowLeaf *leaf = malloc(sizeof(rowLeaf));
+    leaf->n = 0;
+    leaf->total = 0;
+    leaf->bytes = leaf->total_bytes = 0;
+    leaf->prio = rowLeafRandom();
+    leaf->left = leaf->right = NULL;
+    leaf->prev = leaf->next = NULL;
+    return leaf;
+}
+
+// split the tree `t` into the leaves holding the first `k` rows and the rest.
+// `k` has to fall on a leaf boundary
+void rowLeafSplit(rowLeaf *t, int k, rowLeaf **l, rowLeaf **r) {
+    if (t == NULL) {
+        *l = *r = NULL;
+        return;
+    }
+    int lt = rowLeafTotal(t->left);
+    if (k <= lt) {
+        rowLeafSplit(t->left, k, l, &t->left);
+        rowLeafPull(t);
+        *r = t;
+    } else {
+        rowLeafSplit(t->right, k - lt - t->n, &t->right, r);
+        rowLeafPull(t);
+        *l = t;
     }
-    return rx;
 }
 
-int editorRowRxToCx(erow *row, int rx) {
-    int cur_rx = 0, cx;
-    for (cx = 0; cx < row->size; cx++) {
-        if (row->chars[cx] == '\t') {
-            cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
-        }
-        cur_rx++;
+// join two trees, every row of `a` comes before the rows of `b`
+rowLeaf *rowLeafMerge(rowLeaf *a, rowLeaf *b) {
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+    if (a->prio > b->prio) {
+        a->right = rowLeafMerge(a->right, b);
+        rowLeafPull(a);
+        return a;
+    }
+    b->left = rowLeafMerge(a, b->left);
+    rowLeafPull(b);
+    return b;
+}
 
-        if (cur_rx > rx) {
-            return cx;
+// find the leaf holding row `at`, set `slot` to the row's place inside it and
+// `start` to the index of the leaf's first row. When `at` sits between two
+// leaves (or is one past the last row) the leaf on the left is returned, so
+// this can also locate where a row is to be inserted
+rowLeaf *rowLeafFind(int at, int *slot, int *start) {
+    rowLeaf *t = E.buf->rows;
+    *start = 0;
+    while (t) {
+        int lt = rowLeafTotal(t->left);
+        if (t->left && at <= lt) {
+            t = t->left;
+        } else if (at <= lt + t->n) {
+            *slot = at - lt;
+            *start += lt;
+            return t;
+        } else {
+            at -= lt + t->n;
+            *start += lt + t->n;
+            t = t->right;
         }
     }
-    return cx; // in case rx is out of range
+    return NULL;
 }
 
-// expand tab to spaces
-void editorUpdateRow(erow *row) {
-    // count the number of tabs to know how much memory to allocate
-    int num_tabs = 0;
-    for (int j = 0; j < row->size; j++) {
-        if (row->chars[j] == '\t') {
-            num_tabs++;
+// add `delta` rows and `bytes` bytes to every node on the path to where row
+// `at` is to be inserted, see rowLeafFind()
+void rowLeafAdjust(int at, int delta, long long bytes) {
+    rowLeaf *t = E.buf->rows;
+    while (t) {
+        t->total += delta;
+        t->total_bytes += bytes;
+        int lt = rowLeafTotal(t->left);
+        if (t->left && at <= lt) {
+            t = t->left;
+        } else if (at <= lt + t->n) {
+            t->bytes += bytes;
+            return;
+        } else {
+            at -= lt + t->n;
+            t = t->right;
         }
     }
+}
 
-    free(row->render); // free previous row's render
-    row->render = malloc(row->size + num_tabs * (KILO_TAB_STOP - 1) + 1);
-
-    int idx = 0;
-    // expand tabs into spaces
-    for (int j = 0; j < row->size; j++) {
-        if (row->chars[j] == '\t') {
-            row->render[idx++] = ' ';
-            // PAY ATTENTION! tab : spaces != 1 : KILO_TAB_STOP
-            while (idx % KILO_TAB_STOP != 0) {
-                row->render[idx++] = ' ';
-            }
+// the same for the leaf holding the existing row `at`
+void rowLeafAdjustRow(int at, int delta, long long bytes) {
+    rowLeaf *t = E.buf->rows;
+    while (t) {
+        t->total += delta;
+        t->total_bytes += bytes;
+        int lt = rowLeafTotal(t->left);
+        if (at < lt) {
+            t = t->left;
+        } else if (at < lt + t->n) {
+            t->bytes += bytes;
+            return;
         } else {
-            row->render[idx++] = row->chars[j];
+            at -= lt + t->n;
+            t = t->right;
         }
     }
-    row->render[idx] = '\0';
-    row->rsize = idx;
-
-    editorUpdateSyntax(row);
 }
 
-void editorInsertRow(int at, char *s, size_t len) {
-    if (at < 0 || at > E.num_rows)
-        return;
-
-    // each time we append a row to E.rows
-    E.rows = realloc(E.rows, sizeof(erow) * (E.num_rows + 1));
-    memmove(&E.rows[at + 1], &E.rows[at], sizeof(erow) * (E.num_rows - at));
-    // update the index of each row whenever a row is inserted into or removed
-    // from the file
-    for (int i = at + 1; i <= E.num_rows; i++) {
-        E.rows[i].index++;
+// append a filled leaf after the last one, used when loading a file
+void editorRowsAppendLeaf(rowLeaf *leaf) {
+    leaf->prev = E.buf->rows_tail;
+    leaf->next = NULL;
+    if (E.buf->rows_tail) {
+        E.buf->rows_tail->next = leaf;
+    } else {
+        E.buf->rows_head = leaf;
     }
+    E.buf->rows_tail = leaf;
+    rowLeafCount(leaf);
+    rowLeafPull(leaf);
+    E.buf->rows = rowLeafMerge(E.buf->rows, leaf);
+    E.buf->num_rows += leaf->n;
+}
 
-    E.rows[at].index = at;
-    E.rows[at].size = len;
-    E.rows[at].chars = malloc(len + 1);
-    // E.rows[at].chars and s don't overlap, so use memcpy instead of memmove
-    memcpy(E.rows[at].chars, s, len);
-    E.rows[at].chars[len] = '\0';
-
-    E.rows[at].rsize = 0;
-    E.rows[at].render = NULL;
-    E.rows[at].hl = NULL;
-    E.rows[at].hl_open_comment = 0;
-    editorUpdateRow(&E.rows[at]);
-
-    E.num_rows++;
-    E.dirty++;
+// return the row at index `at`, or NULL if there is no such row
+erow *editorRowAt(int at) {
+    if (at < 0 || at >= E.buf->num_rows) {
+        return NULL;
+    }
+    int index = at;
+    rowLeaf *t = E.buf->rows;
+    while (t) {
+        int lt = rowLeafTotal(t->left);
+        if (at < lt) {
+            t = t->left;
+        } else if (at < lt + t->n) {
+            erow *row = &t->rows[at - lt];
+            row->index = index;
+            return row;
+        } else {
+            at -= lt + t->n;
+            t = t->right;
+        }
+    }
+    return NULL;
 }
 
-void editorFreeRow(erow *row) {
-    free(row->render);
-    free(row->chars);
-    free(row->hl);
+erow *editorRowIterStart(rowIter *it, int at) {
+    it->leaf = NULL;
+    it->index = at;
+    if (at < 0 || at >= E.buf->num_rows) {
+        return NULL;
+    }
+    int start;
+    it->leaf = rowLeafFind(at, &it->slot, &start);
+    // rowLeafFind() prefers the end of the left leaf on a boundary
+    if (it->slot == it->leaf->n) {
+        it->leaf = it->leaf->next;
+        it->slot = 0;
+    }
+    erow *row = &it->leaf->rows[it->slot];
+    row->index = at;
+    return row;
 }
 
-void editorDelRow(int at) {
-    if (at < 0 || at >= E.num_rows)
-        return;
-    editorFreeRow(&E.rows[at]); // free current row
-    memmove(&E.rows[at], &E.rows[at + 1], sizeof(erow) * (E.num_rows - at - 1));
-    for (int i = at; i < E.num_rows - 1; i++) {
-        E.rows[i].index--;
+erow *editorRowIterNext(rowIter *it) {
+    if (it->leaf == NULL) {
+        return NULL;
+    }
+    it->index++;
+    if (++it->slot == it->leaf->n) {
+        it->leaf = it->leaf->next;
+        it->slot = 0;
+        if (it->leaf == NULL) {
+            return NULL;
+        }
     }
-    E.num_rows--;
-    E.dirty++;
+    erow *row = &it->leaf->rows[it->slot];
+    row->index = it->index;
+    return row;
+}
+
+// open up a slot for a new row of `size` characters at index `at` and return
+// it, the caller fills in every field. Pointers to other rows may be
+// invalidated
+erow *editorRowsInsert(int at, int size) {
+    if (E.buf->rows == NULL) {
+        rowLeaf *leaf = rowLeafNew();
+        E.buf->rows = E.buf->rows_head = E.buf->rows_tail = leaf;
+    }
+
+    int slot, start;
+    rowLeaf *leaf = rowLeafFind(at, &slot, &start);
+    rowLeaf *target = leaf;
+
+    if (leaf->n == ROW_LEAF_MAX) {
+        // take the full leaf out of the tree, move half of its rows (or none
+        // of them when appending at its end) to a new leaf and put both back
+        rowLeaf *a, *b, *c, *mid;
+        rowLeafSplit(E.buf->rows, start, &a, &b);
+        rowLeafSplit(b, leaf->n, &mid, &c);
+
+        rowLeaf *nl = rowLeafNew();
+        int keep = (slot == leaf->n) ? leaf->n : ROW_LEAF_MAX / 2;
+        nl->n = leaf->n - keep;
+        memcpy(nl->rows, &leaf->rows[keep], sizeof(erow) * nl->n);
+        leaf->n = keep;
+
+        nl->prev = leaf;
+        nl->next = leaf->next;
+        if (leaf->next) {
+            leaf->next->prev = nl;
+        } else {
+            E.buf->rows_tail = nl;
+        }
+        leaf->next = nl;
+
+        if (slot >= keep) {
+            target = nl;
+            slot -= keep;
+        }
+        rowLeafCount(leaf);
+        rowLeafCount(nl);
+        memmove(&target->rows[slot + 1], &target->rows[slot],
+                sizeof(erow) * (target->n - slot));
+        target->n++;
+        target->bytes += size + 1;
+
+        rowLeafPull(leaf);
+        rowLeafPull(nl);
+        E.buf->rows = rowLeafMerge(rowLeafMerge(a, leaf), rowLeafMerge(nl, c));
+    } else {
+        rowLeafAdjust(at, 1, size + 1);
+        memmove(&leaf->rows[slot + 1], &leaf->rows[slot],
+                sizeof(erow) * (leaf->n - slot));
+        leaf->n++;
+    }
+
+    E.buf->num_rows++;
+    erow *row = &target->rows[slot];
+    row->index = at;
+    return row;
+}
+
+// remove the row at index `at` from the tree, the caller frees its buffers
+void editorRowsDelete(int at) {
+    int slot, start;
+    rowLeaf *leaf = rowLeafFind(at, &slot, &start);
+    if (slot == leaf->n) {
+        leaf = leaf->next;
+        slot = 0;
+        start = at;
+    }
+
+    if (leaf->n == 1) {
+        // drop the leaf altogether instead of keeping an empty one around
+        rowLeaf *a, *b, *c, *mid;
+        rowLeafSplit(E.buf->rows, start, &a, &b);
+        rowLeafSplit(b, 1, &mid, &c);
+        E.buf->rows = rowLeafMerge(a, c);
+
+        if (leaf->prev) {
+            leaf->prev->next = leaf->next;
+        } else {
+            E.buf->rows_head = leaf->next;
+        }
+        if (leaf->next) {
+            leaf->next->prev = leaf->prev;
+        } else {
+            E.buf->rows_tail = leaf->prev;
+        }
+        free(leaf);
+    } else {
+        // the row is strictly inside the leaf ([start, start + n)), so the
+        // adjusting walk can follow the lookup rule
+        rowLeafAdjustRow(at, -1, -(leaf->rows[slot].size + 1));
+        memmove(&leaf->rows[slot], &leaf->rows[slot + 1],
+                sizeof(erow) * (leaf->n - slot - 1));
+        leaf->n--;
+    }
+
+    E.buf->num_rows--;
+}
+
+// account for row `at` growing by `delta` characters (or shrinking)
+void editorRowsResized(int at, int delta) {
+    if (delta != 0) {
+        rowLeafAdjustRow(at, 0, delta);
+    }
+}
+
+// bytes in the file, as it would be saved
+long long editorRowsBytes() { return rowLeafTotalBytes(E.buf->rows); }
+
+// the offset of the first byte of row `at` in the file, or the size of the
+// file for `at` == num_rows
+long long editorRowOffset(int at) {
+    long long offset = 0;
+    rowLeaf *t = E.buf->rows;
+    while (t) {
+        int lt = rowLeafTotal(t->left);
+        if (at < lt) {
+            t = t->left;
+        } else if (at < lt + t->n) {
+            offset += rowLeafTotalBytes(t->left);
+            for (int i = 0; i < at - lt; i++) {
+                offset += t->rows[i].size + 1;
+            }
+            return offset;
+        } else {
+            offset += rowLeafTotalBytes(t->left) + t->bytes;
+            at -= lt + t->n;
+            t = t->right;
+        }
+    }
+    return offset;
+}
+
+// the index of the row holding byte `offset` of the file, with `*x` set to
+// where it is in the row (the row's size for its newline). Past the end of
+// the file, that is the end of the last row
+int editorRowAtOffset(long long offset, int *x) {
+    *x = 0;
+    if (E.buf->num_rows == 0) {
+        return 0;
+    }
+    if (offset >= editorRowsBytes()) {
+        *x = editorRowAt(E.buf->num_rows - 1)->size;
+        return E.buf->num_rows - 1;
+    }
+    int index = 0;
+    rowLeaf *t = E.buf->rows;
+    while (t) {
+        long long lb = rowLeafTotalBytes(t->left);
+        if (offset < lb) {
+            t = t->left;
+        } else if (offset < lb + t->bytes) {
+            offset -= lb;
+            index += rowLeafTotal(t->left);
+            for (int i = 0; i < t->n; i++) {
+                if (offset <= t->rows[i].size) {
+                    *x = offset;
+                    return index + i;
+                }
+                offset -= t->rows[i].size + 1;
+            }
+            break;
+        } else {
+            offset -= lb + t->bytes;
+            index += rowLeafTotal(t->left) + t->n;
+            t = t->right;
+        }
+    }
+    return E.buf->num_rows - 1;
+}
+
+/*** syntax highlighting ***/
+
+int is_separator(int c) {
+    // strchr() locates the first occurrence of c in the string pointed to by s
+    return isspace(c) || c == '\0' || strchr("\",.()+-/*=~%<>[];", c) != NULL;
+}
+
+// FNV-1a, spreads the short keywords well enough over a small table
+unsigned int editorKeywordHash(const char *s, int len) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+int editorIsWordByte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+           (c >= 'a' && c <= 'z') || c == '_';
+}
+
+// build the lookup tables of `syntax`. The keyword table is at least twice as
+// big as the list, so probing for a word that is not a keyword ends quickly
+void editorSyntaxCompile(struct editorSyntax *syntax) {
+    if (syntax->tables) {
+        return;
+    }
+    int count = 0;
+    while (syntax->keywords && syntax->keywords[count]) {
+        count++;
+    }
+    unsigned int size = 16;
+    while (size < (unsigned int)count * 2) {
+        size *= 2;
+    }
+    editorSyntaxTables *t = malloc(sizeof(editorSyntaxTables));
+    t->slots = calloc(size, sizeof(editorKeyword));
+    t->mask = size - 1;
+    t->max_len = 0;
+
+    for (int j = 0; j < count; j++) {
+        const char *word = syntax->keywords[j];
+        int len = strlen(word);
+        // the second type of keywords ends with a pipe character
+        unsigned char hl = HL_KEYWORD1;
+        if (len > 0 && word[len - 1] == '|') {
+            len--;
+            hl = HL_KEYWORD2;
+        }
+        if (len == 0) {
+            continue;
+        }
+        unsigned int h = editorKeywordHash(word, len) & t->mask;
+        while (t->slots[h].word) {
+            h = (h + 1) & t->mask;
+        }
+        t->slots[h].word = word;
+        t->slots[h].len = len;
+        t->slots[h].hl = hl;
+        if (len > t->max_len) {
+            t->max_len = len;
+        }
+    }
+
+    char *slcs = syntax->single_line_comment_start;
+    char *mlcs = syntax->multi_line_comment_start;
+    char *mlce = syntax->multi_line_comment_end;
+    t->slcs_len = slcs ? strlen(slcs) : 0;
+    t->mlcs_len = mlcs ? strlen(mlcs) : 0;
+    t->mlce_len = mlce ? strlen(mlce) : 0;
+    if (t->mlcs_len == 0 || t->mlce_len == 0) {
+        t->mlcs_len = t->mlce_len = 0;
+    }
+
+    // bytes that start a comment or a string need a closer look, everything
+    // else that is not a separator is part of a word
+    for (int c = 0; c < 256; c++) {
+        t->cls[c] = is_separator(c) ? CLS_SEP : CLS_WORD;
+    }
+    char *starts[] = {t->slcs_len ? slcs : NULL, t->mlcs_len ? mlcs : NULL};
+    for (int j = 0; j < 2; j++) {
+        if (starts[j]) {
+            unsigned char c = starts[j][0];
+            t->cls[c] = (t->cls[c] & ~CLS_WORD) | CLS_COMMENT;
+        }
+    }
+    if (syntax->flags & HL_HIGHLIGHT_STRINGS) {
+        char *quotes = syntax->quotes ? syntax->quotes : "\"'";
+        for (int j = 0; quotes[j]; j++) {
+            unsigned char c = quotes[j];
+            t->cls[c] = (t->cls[c] & ~CLS_WORD) | CLS_QUOTE;
+        }
+    }
+    // digits are part of words as well, but start a number after a separator
+    if (syntax->flags & HL_HIGHLIGHT_NUMBERS) {
+        for (int c = '0'; c <= '9'; c++) {
+            t->cls[c] |= CLS_NUMBER;
+        }
+        t->cls['.'] |= CLS_NUMBER;
+    }
+
+    t->fast_word = 1;
+    for (int c = 0; c < 256; c++) {
+        if (editorIsWordByte(c) && (t->cls[c] & ~CLS_NUMBER) != CLS_WORD) {
+            t->fast_word = 0;
+        }
+    }
+    t->fast_space = (t->cls[' '] == CLS_SEP);
+    for (int j = 0; j < 2; j++) {
+        if (starts[j] && starts[j][0] == ' ') {
+            t->fast_space = 0;
+        }
+    }
+    syntax->tables = t;
+}
+
+// return HL_KEYWORD1 or HL_KEYWORD2 if the `len` characters at `s` are a
+// keyword, HL_NORMAL otherwise
+unsigned char editorKeywordLookup(editorSyntaxTables *t, const char *s,
+                                  int len) {
+    unsigned int h = editorKeywordHash(s, len) & t->mask;
+    while (t->slots[h].word) {
+        editorKeyword *slot = &t->slots[h];
+        if (slot->len == len && !memcmp(slot->word, s, len)) {
+            return slot->hl;
+        }
+        h = (h + 1) & t->mask;
+    }
+    return HL_NORMAL;
+}
+
+// The scans below look at 16 bytes at a time where the machine has vector
+// instructions for it (SSE2 or NEON), the plain loop after them finishes the
+// last bytes or the block in which the run ends
+
+// length of the run of letters, digits and '_' at the start of `s`
+int editorScanWord(const char *s, int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_set1_epi8('0'), nine = _mm_set1_epi8(9);
+    const __m128i lower = _mm_set1_epi8(0x20), a = _mm_set1_epi8('a');
+    const __m128i z = _mm_set1_epi8(25), under = _mm_set1_epi8('_');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        // x <= k for unsigned bytes is min(x, k) == x
+        __m128i d = _mm_sub_epi8(v, zero);
+        __m128i l = _mm_sub_epi8(_mm_or_si128(v, lower), a);
+        __m128i ok = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(d, nine), d),
+                         _mm_cmpeq_epi8(_mm_min_epu8(l, z), l)),
+            _mm_cmpeq_epi8(v, under));
+        int mask = _mm_movemask_epi8(ok);
+        if (mask != 0xffff) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)s + i);
+        uint8x16_t d = vsubq_u8(v, vdupq_n_u8('0'));
+        uint8x16_t l = vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+        uint8x16_t ok = vorrq_u8(vorrq_u8(vcleq_u8(d, vdupq_n_u8(9)),
+                                          vcleq_u8(l, vdupq_n_u8(25))),
+                                 vceqq_u8(v, vdupq_n_u8('_')));
+        if (vminvq_u8(ok) != 0xff) {
+            break;
+        }
+    }
+#endif
+    while (i < n && editorIsWordByte(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+// length of the run of `c` at the start of `s`
+int editorScanByte(const char *s, int n, char c) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i vc = _mm_set1_epi8(c);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, vc));
+        if (mask != 0xffff) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    const uint8x16_t vc = vdupq_n_u8(c);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)s + i);
+        if (vminvq_u8(vceqq_u8(v, vc)) != 0xff) {
+            break;
+        }
+    }
+#endif
+    while (i < n && s[i] == c) {
+        i++;
+    }
+    return i;
+}
+
+// index of the first `a` or `b` in `s`, or `n` if there is none
+int editorScanUntil(const char *s, int n, char a, char b) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        int mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    const uint8x16_t va = vdupq_n_u8(a), vb = vdupq_n_u8(b);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)s + i);
+        if (vmaxvq_u8(vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb)))) {
+            break;
+        }
+    }
+#endif
+    while (i < n && s[i] != a && s[i] != b) {
+        i++;
+    }
+    return i;
+}
+
+// length of the rest of a word at the start of `s`
+int editorScanPlain(editorSyntaxTables *t, const char *s, int n) {
+    int i = 0;
+    while (i < n) {
+        if (t->fast_word) {
+            i += editorScanWord(s + i, n - i);
+        }
+        if (i < n && (t->cls[(unsigned char)s[i]] & CLS_WORD)) {
+            i++;
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+// highlight a row again after its render changed at [from, stop). Everything
+// in `hl` outside that range must still be the highlighting of the old render,
+// moved along with the characters it belongs to. The work starts from the last
+// point before `from` where the highlighter was in its plain state (outside of
+// strings and comments, right after a separator) and ends at the first point
+// after `stop` where the old and the new highlighting are both back in that
+// state, since the rest of the row can't change from there on. With `stop` < 0
+// the whole row is highlighted from scratch.
+// This only works on the given buffers, so the highlighting thread can use it
+// as well. `in_comment` tells whether the row above ends inside a multi-line
+// comment. Returns whether the row itself does, or -1 if the work stopped
+// early because nothing after `stop` changed
+int editorHighlightLine(struct editorSyntax *syntax, const char *render,
+                        int rsize, unsigned char *hl, int from, int stop,
+                        int in_comment) {
+    if (syntax == NULL) {
+        // `hl` is allocated together with `render` in editorUpdateRow()
+        if (stop < 0) {
+            memset(hl, HL_NORMAL, rsize);
+            return 0;
+        }
+        return -1;
+    }
+
+    editorSyntaxTables *t = syntax->tables;
+    char *slcs = syntax->single_line_comment_start;
+    char *mlcs = syntax->multi_line_comment_start;
+    char *mlce = syntax->multi_line_comment_end;
+    int slcs_len = t->slcs_len, mlcs_len = t->mlcs_len, mlce_len = t->mlce_len;
+    // the row above may have been highlighted with another syntax
+    if (mlce_len == 0) {
+        in_comment = 0;
+    }
+
+    int i = 0;
+    if (stop >= 0) {
+        // back off far enough that no comment delimiter starting before `i`
+        // can reach into the edit, then look for the plain state
+        int max_len = slcs_len > mlcs_len ? slcs_len : mlcs_len;
+        if (mlce_len > max_len) {
+            max_len = mlce_len;
+        }
+        i = from - max_len;
+        if (i < 0) {
+            i = 0;
+        }
+        while (i > 0 && !(hl[i - 1] == HL_NORMAL &&
+                          (t->cls[(unsigned char)render[i - 1]] & CLS_SEP))) {
+            i--;
+        }
+    }
+
+    int prev_sep = 1;
+    int in_string = 0;
+    // the state of the previous row only matters when starting at the front,
+    // a restart point further in is outside of any comment
+    if (i > 0) {
+        in_comment = 0;
+    }
+
+    while (i < rsize) {
+        char c = render[i];
+        unsigned char prev_hl = (i > 0) ? hl[i - 1] : HL_NORMAL;
+
+        // skip over bytes that can't change the state in one go: the body of
+        // a comment or a string up to the next byte that may end it, the rest
+        // of a word that is not a keyword, and runs of spaces (which may only
+        // go up to `stop`, where the convergence check has to see them)
+        int run = 0;
+        unsigned char run_hl = HL_NORMAL;
+        if (in_comment) {
+            const char *end = memchr(&render[i], mlce[0], rsize - i);
+            run = end ? end - &render[i] : rsize - i;
+            run_hl = HL_MLCOMMENT;
+        } else if (in_string) {
+            run = editorScanUntil(&render[i], rsize - i, in_string, '\\');
+            run_hl = HL_STRING;
+        } else if (!prev_sep && prev_hl == HL_NORMAL) {
+            run = editorScanPlain(t, &render[i], rsize - i);
+        } else if (c == ' ' && t->fast_space && (stop < 0 || i < stop)) {
+            int end = stop < 0 ? rsize : stop;
+            run = editorScanByte(&render[i], end - i, ' ');
+            prev_sep = 1;
+        }
+        if (run > 0) {
+            memset(&hl[i], run_hl, run);
+            i += run;
+            // every byte of a string counts as a separator
+            if (in_string) {
+                prev_sep = 1;
+            }
+            continue;
+        }
+
+        // inside a comment or a string, only its end matters
+        if (in_comment) {
+            if (c == mlce[0] && !strncmp(&render[i], mlce, mlce_len)) {
+                memset(&hl[i], HL_MLCOMMENT, mlce_len);
+                i += mlce_len;
+                in_comment = 0;
+                prev_sep = 1;
+            } else {
+                hl[i++] = HL_MLCOMMENT;
+            }
+            continue;
+        }
+        if (in_string) {
+            hl[i] = HL_STRING;
+            // take escaped quotes into account (\' or \")
+            if (c == '\\' && i + 1 < rsize) {
+                hl[i + 1] = HL_STRING;
+                i += 2;
+                continue;
+            }
+            if (c == in_string) {
+                in_string = 0;
+            }
+            i++;
+            prev_sep = 1;
+            continue;
+        }
+
+        // the classes tell which of the bytes may start something, the ones
+        // the syntax doesn't have are never looked at
+        unsigned char cls = t->cls[(unsigned char)c];
+        if (cls & CLS_COMMENT) {
+            // the multi-line start first, it may begin with the single-line
+            // one, like Lua's "--[[" and "--"
+            if (mlcs_len && c == mlcs[0] &&
+                !strncmp(&render[i], mlcs, mlcs_len)) {
+                memset(&hl[i], HL_MLCOMMENT, mlcs_len);
+                i += mlcs_len;
+                in_comment = 1;
+                continue;
+            }
+            // compares not more than slcs_len characters
+            if (slcs_len && c == slcs[0] &&
+                !strncmp(&render[i], slcs, slcs_len)) {
+                memset(&hl[i], HL_COMMENT, rsize - i);
+                break;
+            }
+        }
+
+        // highlight quoted strings
+        if (cls & CLS_QUOTE) {
+            in_string = c;
+            hl[i] = HL_STRING;
+            i++;
+            continue;
+        }
+
+        // avoid highlighting "32" in "int32_t"
+        if ((cls & CLS_NUMBER) &&
+            (c == '.' ? prev_hl == HL_NUMBER
+                      : (prev_sep || prev_hl == HL_NUMBER))) {
+            hl[i] = HL_NUMBER;
+            i++;
+            prev_sep = 0;
+            continue;
+        }
+
+        if (prev_sep) {
+            // a keyword is a whole word: find where the word starting here
+            // ends (giving up once it's longer than any keyword) and look it
+            // up once, instead of comparing every keyword against it
+            int kw_max = t->max_len;
+            int klen = 0;
+            while (klen <= kw_max && i + klen < rsize &&
+                   (t->cls[(unsigned char)render[i + klen]] & CLS_SEP) == 0) {
+                klen++;
+            }
+            if (klen > 0 && klen <= kw_max) {
+                unsigned char kw =
+                    editorKeywordLookup(t, &render[i], klen);
+                if (kw != HL_NORMAL) {
+                    memset(&hl[i], kw, klen);
+                    i += klen;
+                    prev_sep = 0;
+                    continue;
+                }
+            }
+        }
+
+        // a plain character: if it was plain in the old highlighting as well,
+        // both runs are in the same state from here on
+        int sep = t->cls[(unsigned char)c] & CLS_SEP;
+        int converged = (stop >= 0 && i >= stop && hl[i] == HL_NORMAL && sep);
+        hl[i] = HL_NORMAL;
+        prev_sep = sep != 0;
+        i++;
+        if (converged) {
+            return -1;
+        }
+    }
+
+    // whether the row ended as unclosed multi-line comment or not
+    return in_comment;
+}
+
+// highlight the `size` characters of a row that has no view in the buffers of
+// `s`, only to find out whether it ends inside a multi-line comment
+int editorHighlightScratch(struct editorSyntax *syntax, hlScratch *s,
+                           const char *chars, int size, int in_comment) {
+    if (syntax == NULL || !syntax->multi_line_comment_start ||
+        !syntax->multi_line_comment_end) {
+        return 0;
+    }
+    colMap *cols = editorColsBuild(chars, size);
+    int need = editorRenderLen(size, cols) + 1;
+    if (s->cap < need) {
+        s->cap = editorGrowCap(s->cap, need);
+        s->render = realloc(s->render, s->cap);
+        s->hl = realloc(s->hl, s->cap);
+    }
+    int rsize = editorRenderText(chars, size, cols, s->render);
+    free(cols);
+    return editorHighlightLine(syntax, s->render, rsize, s->hl, 0, -1,
+                               in_comment);
+}
+
+// returns whether the row's `hl_open_comment` changed, which means the rows
+// after it have to be highlighted again
+int editorHighlightRow(erow *row, int from, int stop) {
+    erow *prev = editorRowAt(row->index - 1);
+    int in_comment = prev && prev->hl_open_comment;
+    rowView *v = row->view;
+    struct editorSyntax *syntax = E.buf->syntax;
+    int open = v ? editorHighlightLine(syntax, v->render, v->rsize, v->hl, from,
+                                       stop, in_comment)
+                 : editorHighlightScratch(syntax, &E.hl_scratch, row->chars,
+                                          row->size, in_comment);
+    if (open < 0) {
+        return 0;
+    }
+    int changed = (row->hl_open_comment != open);
+    row->hl_open_comment = open;
+    return changed;
+}
+
+void editorUpdateSyntaxFrom(erow *row, int from, int stop) {
+    PROFILE_BEGIN(start);
+    if (editorHighlightRow(row, from, stop)) {
+        editorSyntaxPropagate(row->index + 1);
+    }
+    PROFILE_END(PROFILE_SYNTAX, start);
+}
+
+void editorUpdateSyntax(erow *row) { editorUpdateSyntaxFrom(row, 0, -1); }
+
+// remember that row `at` has to be highlighted again
+void editorMarkStale(int at) {
+    editorBuffer *b = E.buf;
+    // rows past hl_ready are highlighted from scratch anyway
+    if (at >= b->hl_ready) {
+        return;
+    }
+    int i = 0;
+    while (i < b->hl_stale_len && b->hl_stale[i] < at) {
+        i++;
+    }
+    if (i < b->hl_stale_len && b->hl_stale[i] == at) {
+        return;
+    }
+    if (b->hl_stale_len == b->hl_stale_cap) {
+        b->hl_stale_cap = editorGrowCap(b->hl_stale_cap, b->hl_stale_len + 1);
+        b->hl_stale = realloc(b->hl_stale, sizeof(int) * b->hl_stale_cap);
+    }
+    memmove(&b->hl_stale[i + 1], &b->hl_stale[i],
+            sizeof(int) * (b->hl_stale_len - i));
+    b->hl_stale[i] = at;
+    b->hl_stale_len++;
+}
+
+// keep the stale marks pointing at the same rows when `delta` rows are
+// inserted (1) or deleted (-1) at index `at`
+void editorShiftStale(int at, int delta) {
+    int j = 0;
+    for (int i = 0; i < E.buf->hl_stale_len; i++) {
+        int s = E.buf->hl_stale[i];
+        if (s > at || (s == at && delta > 0)) {
+            s += delta;
+        }
+        // a deleted row's mark now falls on the row after it, which may
+        // already have a mark of its own
+        if (s >= E.buf->hl_ready || (j > 0 && E.buf->hl_stale[j - 1] == s)) {
+            continue;
+        }
+        E.buf->hl_stale[j++] = s;
+    }
+    E.buf->hl_stale_len = j;
+}
+
+// The row above `at` ended in a different multi-line comment state than
+// before, so `at` and possibly many rows after it have to be highlighted
+// again. Only the rows on the screen are done right away, one after the other
+// until a row ends in the same state as before. If that doesn't happen on the
+// screen, the first row below it is marked stale and picked up when it is
+// scrolled to (editorPrepareRows()) or when the editor is idle
+// (editorSyntaxIdle()), so a keystroke never walks the whole file
+void editorSyntaxPropagate(int at) {
+    int bottom = E.win->row_off + E.win->screen_rows;
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, at); row;
+         row = editorRowIterNext(&it)) {
+        if (row->index >= E.buf->hl_ready) {
+            return;
+        }
+        if (row->index >= bottom) {
+            editorMarkStale(row->index);
+            return;
+        }
+        if (!editorHighlightRow(row, 0, -1)) {
+            return;
+        }
+    }
+}
+
+// highlight rows again starting at the first stale mark, until a row ends in
+// the state it had before, row `limit` is reached or `budget` rows are done.
+// Returns how many rows were highlighted
+int editorSettleStale(int limit, int budget) {
+    int done = 0;
+    editorBuffer *b = E.buf;
+    while (b->hl_stale_len > 0 && b->hl_stale[0] < limit && done < budget) {
+        int at = b->hl_stale[0];
+        b->hl_stale_len--;
+        memmove(&b->hl_stale[0], &b->hl_stale[1],
+                sizeof(int) * b->hl_stale_len);
+
+        rowIter it;
+        for (erow *row = editorRowIterStart(&it, at); row;
+             row = editorRowIterNext(&it)) {
+            if (row->index >= b->hl_ready) {
+                break;
+            }
+            if (row->index >= limit || done == budget) {
+                editorMarkStale(row->index);
+                break;
+            }
+            // this walk covers the next mark as well
+            if (b->hl_stale_len > 0 && b->hl_stale[0] == row->index) {
+                b->hl_stale_len--;
+                memmove(&b->hl_stale[0], &b->hl_stale[1],
+                        sizeof(int) * b->hl_stale_len);
+            }
+            done++;
+            if (!editorHighlightRow(row, 0, -1)) {
+                break;
+            }
+        }
+    }
+    return done;
+}
+
+// called while waiting for input, catches up on stale rows off the screen.
+// Returns whether the highlighting thread has finished something meanwhile,
+// which the screen should show
+int editorSyntaxIdle() {
+    editorSettleStale(E.buf->num_rows, KILO_HL_IDLE_ROWS);
+    return editorHlThreadDone();
+}
+
+// whether highlighting a row depends on the rows above it
+int editorSyntaxHasState() {
+    return E.buf->syntax && E.buf->syntax->multi_line_comment_start &&
+           E.buf->syntax->multi_line_comment_end;
+}
+
+int editorSyntaxToColor(int hl) {
+    switch (hl) {
+    case HL_COMMENT:
+    case HL_MLCOMMENT:
+        return 36;
+    case HL_KEYWORD1:
+        return 33;
+    case HL_KEYWORD2:
+        return 32;
+    case HL_STRING:
+        return 35;
+    case HL_NUMBER:
+        return 31; // foreground red
+    case HL_MATCH:
+        return 34; // foreground blue
+    default:
+        return 37; // foreground white
+    }
+}
+
+// find the syntax for the `len` characters at `match`, NULL if none
+struct editorSyntax *editorSyntaxFind(const char *match, int len) {
+    if (E.syntax_slots == NULL) {
+        return NULL;
+    }
+    unsigned int h = editorKeywordHash(match, len) & E.syntax_mask;
+    while (E.syntax_slots[h].match) {
+        syntaxMatch *slot = &E.syntax_slots[h];
+        if (!strncmp(slot->match, match, len) && slot->match[len] == '\0') {
+            return slot->syntax;
+        }
+        h = (h + 1) & E.syntax_mask;
+    }
+    return NULL;
+}
+
+void editorSyntaxInsert(const char *match, struct editorSyntax *syntax) {
+    unsigned int h = editorKeywordHash(match, strlen(match)) & E.syntax_mask;
+    while (E.syntax_slots[h].match) {
+        h = (h + 1) & E.syntax_mask;
+    }
+    E.syntax_slots[h].match = match;
+    E.syntax_slots[h].syntax = syntax;
+    E.syntax_used++;
+}
+
+// make the file names `syntax` matches find it. A name that already finds
+// another syntax keeps it, so the syntaxes added first win. The table stays
+// at most half full
+void editorSyntaxAdd(struct editorSyntax *syntax) {
+    for (int j = 0; syntax->file_match[j]; j++) {
+        const char *match = syntax->file_match[j];
+        if (editorSyntaxFind(match, strlen(match))) {
+            continue;
+        }
+        unsigned int size = E.syntax_slots ? E.syntax_mask + 1 : 0;
+        if (2 * (unsigned int)(E.syntax_used + 1) > size) {
+            syntaxMatch *old = E.syntax_slots;
+            unsigned int old_size = size;
+            size = size ? size * 2 : 64;
+            E.syntax_slots = calloc(size, sizeof(syntaxMatch));
+            E.syntax_mask = size - 1;
+            E.syntax_used = 0;
+            for (unsigned int k = 0; k < old_size; k++) {
+                if (old[k].match) {
+                    editorSyntaxInsert(old[k].match, old[k].syntax);
+                }
+            }
+            free(old);
+        }
+        editorSyntaxInsert(match, syntax);
+    }
+}
+
+// append `word` to the NULL-terminated `*list`, with `suffix` after it
+void editorWordsAppend(char ***list, const char *word, const char *suffix) {
+    int n = 0;
+    while ((*list)[n]) {
+        n++;
+    }
+    *list = realloc(*list, sizeof(char *) * (n + 2));
+    char *copy = malloc(strlen(word) + strlen(suffix) + 1);
+    strcpy(copy, word);
+    strcat(copy, suffix);
+    (*list)[n] = copy;
+    (*list)[n + 1] = NULL;
+}
+
+// Read more file types from the file `path`, if there is one. A line is a
+// key and the words after it, `#` starts a comment line:
+//
+//   syntax lua                  starts a file type and names it
+//   match .lua                  file names and extensions it is for
+//   keywords if then end        highlighted as keywords
+//   types nil true false        highlighted as the second type of keywords
+//   comment --                  starts a comment up to the end of the line
+//   multiline --[[ ]]           starts and ends a multi-line comment
+//   strings "'                  quote strings, with " and ' if none given
+//   numbers                     highlight numbers
+//
+// The syntaxes of the file are added before the built-in ones, so they can
+// replace them. Lines that are not understood are skipped, the status bar
+// tells about the first one
+void editorSyntaxLoad(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return;
+    }
+    const char *space = " \t\r\n";
+    struct editorSyntax *syntax = NULL;
+    char line[1024];
+    int line_no = 0, error = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        // the key and up to 63 words after it
+        char *words[64];
+        int n = 0;
+        for (char *w = strtok(line, space); w && n < 63;
+             w = strtok(NULL, space)) {
+            words[n++] = w;
+        }
+        words[n] = NULL;
+        if (n == 0 || words[0][0] == '#') {
+            continue;
+        }
+        char *key = words[0], *arg = words[1], *arg2 = arg ? words[2] : NULL;
+        int ok = 1;
+        if (!strcmp(key, "syntax") && arg) {
+            if (syntax) {
+                editorSyntaxAdd(syntax);
+            }
+            syntax = calloc(1, sizeof(struct editorSyntax));
+            syntax->file_type = strdup(arg);
+            syntax->file_match = calloc(1, sizeof(char *));
+            syntax->keywords = calloc(1, sizeof(char *));
+        } else if (syntax == NULL) {
+            ok = 0;
+        } else if (!strcmp(key, "match") || !strcmp(key, "keywords") ||
+                   !strcmp(key, "types")) {
+            char ***list =
+                key[0] == 'm' ? &syntax->file_match : &syntax->keywords;
+            const char *suffix = key[0] == 't' ? "|" : "";
+            for (int j = 1; j < n; j++) {
+                editorWordsAppend(list, words[j], suffix);
+            }
+        } else if (!strcmp(key, "comment") && arg) {
+            syntax->single_line_comment_start = strdup(arg);
+        } else if (!strcmp(key, "multiline") && arg2) {
+            syntax->multi_line_comment_start = strdup(arg);
+            syntax->multi_line_comment_end = strdup(arg2);
+        } else if (!strcmp(key, "strings")) {
+            syntax->flags |= HL_HIGHLIGHT_STRINGS;
+            syntax->quotes = arg ? strdup(arg) : NULL;
+        } else if (!strcmp(key, "numbers")) {
+            syntax->flags |= HL_HIGHLIGHT_NUMBERS;
+        } else {
+            ok = 0;
+        }
+        if (!ok && !error) {
+            error = 1;
+            editorSetStatusMessage("%.40s:%d: can't make sense of `%.20s`",
+                                   path, line_no, key);
+        }
+    }
+    if (syntax) {
+        editorSyntaxAdd(syntax);
+    }
+    fclose(f);
+}
+
+// the syntaxes of the file KILO_SYNTAX names (~/.kilosyntax by default), then
+// the built-in ones
+void editorSyntaxInit() {
+    char *path = getenv("KILO_SYNTAX");
+    char *home = getenv("HOME");
+    char buf[PATH_MAX];
+    if (path == NULL && home) {
+        snprintf(buf, sizeof(buf), "%s/.kilosyntax", home);
+        path = buf;
+    }
+    if (path) {
+        editorSyntaxLoad(path);
+    }
+    for (unsigned int i = 0; i < HLDB_ENTRIES; i++) {
+        editorSyntaxAdd(&HLDB[i]);
+    }
+}
+
+// pick the syntax by the name of the file, or else by its extension (what
+// comes after the last '.' of the name), both looked up in one go
+void editorSelectSyntaxHighlight() {
+    E.buf->syntax = NULL;
+    if (E.buf->file_name == NULL) {
+        return;
+    }
+
+    // strrchr() locates the last occurence of c in s
+    char *name = strrchr(E.buf->file_name, '/');
+    name = name ? name + 1 : E.buf->file_name;
+    struct editorSyntax *s = editorSyntaxFind(name, strlen(name));
+    // get a pointer to the extension part of filename
+    char *ext = strrchr(name, '.');
+    if (s == NULL && ext) {
+        s = editorSyntaxFind(ext, strlen(ext));
+    }
+    if (s == NULL) {
+        return;
+    }
+    editorSyntaxCompile(s);
+    E.buf->syntax = s;
+    // every row has to be highlighted again, which happens lazily as they are
+    // drawn or in the highlighting thread
+    E.buf->hl_ready = 0;
+    E.buf->hl_stale_len = 0;
+    E.buf->hl_epoch = ++E.version_clock;
+}
+/*** undo ***/
+
+// The row operations below record the changes they make to the text (see
+// `undoRecord`), a step for each keypress, and a run of typed characters is
+// merged into one record. Undoing a step applies its records backwards with
+// the same row operations, which record nothing meanwhile
+
+void editorUndoInit() {
+    E.buf->undo = (undoLog){0};
+    long mb = KILO_UNDO_MB;
+    char *env = getenv("KILO_UNDO_MB");
+    if (env) {
+        mb = strtol(env, NULL, 10);
+    }
+    // 0 turns undo off
+    E.buf->undo.limit = (size_t)(mb > 0 ? mb : 0) * 1024 * 1024;
+    E.buf->undo.step = 1;
+}
+
+// start the step of the next keypress
+void editorUndoBoundary() {
+    // 0 is never a step, see `skip`
+    if (++E.buf->undo.step == 0) {
+        E.buf->undo.step = 1;
+    }
+    E.buf->undo.step_cy = E.win->cy;
+    E.buf->undo.step_cx = E.win->cx;
+}
+
+// drop every record and the whole arena
+void editorUndoClear() {
+    undoLog *U = &E.buf->undo;
+    while (U->head) {
+        undoChunk *next = U->head->next;
+        free(U->head);
+        U->head = next;
+    }
+    U->tail = NULL;
+    free(U->records);
+    U->records = NULL;
+    U->len = U->cap = U->at = 0;
+    U->size = 0;
+}
+
+// drop the records that could be redone. Their bytes are the newest ones in
+// the arena, so the arena just shrinks back to where they started
+void editorUndoDropRedo() {
+    undoLog *U = &E.buf->undo;
+    if (U->at == U->len) {
+        return;
+    }
+    undoRecord *r = &U->records[U->at];
+    while (U->tail != r->chunk) {
+        undoChunk *c = U->tail;
+        U->tail = c->prev;
+        U->tail->next = NULL;
+        U->size -= sizeof(undoChunk) + c->cap;
+        free(c);
+    }
+    r->chunk->used = r->bytes - r->chunk->data;
+    U->size -= (U->len - U->at) * sizeof(undoRecord);
+    U->len = U->at;
+}
+
+// Drop the oldest steps once the log holds more than its limit, down to 3/4
+// of it so that this doesn't happen on every change. If the step being
+// recorded is all that is left, it is too large to undo: it is dropped as
+// well, and nothing more of it is recorded
+void editorUndoTrim() {
+    undoLog *U = &E.buf->undo;
+    if (U->size <= U->limit) {
+        return;
+    }
+    size_t target = U->limit / 4 * 3;
+    int n = 0;
+    while (n < U->len && U->size > target) {
+        unsigned int step = U->records[n].step;
+        if (step == U->step) {
+            U->skip = step;
+            editorUndoClear();
+            return;
+        }
+        while (n < U->len && U->records[n].step == step) {
+            n++;
+        }
+        // chunks before the one the oldest record left uses are free
+        undoChunk *keep = n < U->len ? U->records[n].chunk : NULL;
+        while (U->head != keep && U->head != U->tail) {
+            undoChunk *c = U->head;
+            U->head = c->next;
+            U->head->prev = NULL;
+            U->size -= sizeof(undoChunk) + c->cap;
+            free(c);
+        }
+        U->size -= (size_t)n * sizeof(undoRecord);
+        memmove(U->records, &U->records[n], sizeof(undoRecord) * (U->len - n));
+        U->len -= n;
+        U->at -= n;
+        n = 0;
+    }
+    if (U->len == 0 && U->tail) {
+        U->tail->used = 0;
+    }
+}
+
+// Add a record of a change of `len` bytes at position `x` of row `y`, and
+// return where its bytes go, which the caller fills in. Returns NULL if the
+// change is not recorded
+char *editorUndoAdd(int type, int y, int x, int len) {
+    undoLog *U = &E.buf->undo;
+    if (U->paused || len == 0 || U->limit == 0 || U->step == U->skip) {
+        return NULL;
+    }
+    editorUndoDropRedo();
+    editorUndoTrim();
+    if (U->step == U->skip) {
+        return NULL;
+    }
+
+    undoChunk *c = U->tail;
+    if (c == NULL || c->cap - c->used < (size_t)len) {
+        size_t cap = len > KILO_UNDO_CHUNK ? (size_t)len : KILO_UNDO_CHUNK;
+        c = malloc(sizeof(undoChunk) + cap);
+        c->prev = U->tail;
+        c->next = NULL;
+        c->used = 0;
+        c->cap = cap;
+        if (U->tail) {
+            U->tail->next = c;
+        } else {
+            U->head = c;
+        }
+        U->tail = c;
+        U->size += sizeof(undoChunk) + cap;
+    }
+    if (U->len == U->cap) {
+        U->cap = editorGrowCap(U->cap, U->len + 1);
+        U->records = realloc(U->records, sizeof(undoRecord) * U->cap);
+    }
+    undoRecord *r = &U->records[U->len++];
+    r->type = type;
+    r->step = U->step;
+    r->y = y;
+    r->x = x;
+    r->len = len;
+    r->typed = 0;
+    r->bytes = &c->data[c->used];
+    r->chunk = c;
+    r->cy = U->step_cy;
+    r->cx = U->step_cx;
+    c->used += len;
+    U->size += sizeof(undoRecord);
+    U->at = U->len;
+    return r->bytes;
+}
+
+// record a change of the `len` bytes at `s`
+void editorUndoCopy(int type, int y, int x, const char *s, int len) {
+    char *bytes = editorUndoAdd(type, y, x, len);
+    if (bytes) {
+        memcpy(bytes, s, len);
+    }
+}
+
+// record typing `c` at position `x` of row `y`. Right after the characters
+// typed before it, it goes into their record and into their step
+void editorUndoTyped(int y, int x, char c) {
+    undoLog *U = &E.buf->undo;
+    undoRecord *last = U->at > 0 ? &U->records[U->at - 1] : NULL;
+    if (!U->paused && c != '\n' && last && last->typed && last->y == y &&
+        last->x + last->len == x) {
+        U->step = last->step;
+        undoChunk *t = U->tail;
+        if (U->at == U->len && last->chunk == t &&
+            last->bytes + last->len == &t->data[t->used] && t->used < t->cap) {
+            last->bytes[last->len++] = c;
+            t->used++;
+            return;
+        }
+    }
+    char *bytes = editorUndoAdd(UNDO_INSERT, y, x, 1);
+    if (bytes) {
+        *bytes = c;
+        E.buf->undo.records[E.buf->undo.len - 1].typed = 1;
+    }
+}
+
+/*** utf-8 ***/
+
+// the length of the ASCII text at the start of the `n` bytes at `s`, checked
+// a word at a time
+int editorAsciiSpan(const char *s, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        unsigned long long w;
+        memcpy(&w, &s[i], 8);
+        if (w & 0x8080808080808080ull) {
+            break;
+        }
+    }
+    while (i < n && !(s[i] & 0x80)) {
+        i++;
+    }
+    return i;
+}
+
+// the code point of the UTF-8 character at the start of the `n` bytes at `s`,
+// and its length in `*len`. A byte that doesn't start a valid sequence
+// (overlong forms and surrogates included) is taken on its own and gives -1
+int editorUtf8Decode(const char *s, int n, int *len) {
+    const unsigned char *p = (const unsigned char *)s;
+    *len = 1;
+    if (p[0] < 0x80) {
+        return p[0];
+    }
+    int more, cp, min;
+    if ((p[0] & 0xe0) == 0xc0) {
+        more = 1, cp = p[0] & 0x1f, min = 0x80;
+    } else if ((p[0] & 0xf0) == 0xe0) {
+        more = 2, cp = p[0] & 0x0f, min = 0x800;
+    } else if ((p[0] & 0xf8) == 0xf0) {
+        more = 3, cp = p[0] & 0x07, min = 0x10000;
+    } else {
+        return -1;
+    }
+    if (more >= n) {
+        return -1;
+    }
+    for (int i = 1; i <= more; i++) {
+        if ((p[i] & 0xc0) != 0x80) {
+            return -1;
+        }
+        cp = cp << 6 | (p[i] & 0x3f);
+    }
+    if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp < 0xe000)) {
+        return -1;
+    }
+    *len = more + 1;
+    return cp;
+}
+
+// the columns the character `cp` takes on the screen: 0 for combining marks
+// and the other characters that go with the one before them, 2 for wide ones
+// (most of CJK), and -1 for the ones that can't be shown as they are, control
+// characters and bytes that aren't UTF-8 (-1 too)
+int editorCharWidth(int cp) {
+    if (cp < 0x20 || (cp >= 0x7f && cp < 0xa0)) {
+        return -1;
+    }
+    if (cp < 0x20000) {
+        int block = charWidthIndex[cp >> 7];
+        int bits = charWidthBlocks[block * 32 + ((cp & 0x7f) >> 2)];
+        return (bits >> ((cp & 3) * 2)) & 3;
+    }
+    // the ideographs of planes 2 and 3, then tags and variation selectors
+    if (cp < 0x40000) {
+        return 2;
+    }
+    return (cp >= 0xe0000 && cp < 0xe1000) ? 0 : 1;
+}
+
+// editorCharWidth() of the character at the start of the `n` bytes at `s`,
+// with its length in `*len`
+int editorUtf8Width(const char *s, int n, int *len) {
+    unsigned char c = s[0];
+    if (c < 0x80) {
+        *len = 1;
+        return (c < 0x20 || c == 0x7f) ? -1 : 1;
+    }
+    return editorCharWidth(editorUtf8Decode(s, n, len));
+}
+
+/*** row operations ***/
+
+// find the characters of `chars` for editorColsBuild() and fill them into
+// `m` (unless it is NULL), returning how many there are. In ASCII text only
+// the tabs count
+int editorColsWalk(const char *chars, int size, int ascii, colMap *m) {
+    // `cx`, `ri` and `rx` are where the last character found ends
+    int n = 0, cx = 0, ri = 0, rx = 0;
+    while (cx < size) {
+        int at = cx;
+        if (ascii) {
+            const char *tab = memchr(&chars[cx], '\t', size - cx);
+            at = tab ? tab - chars : size;
+        } else {
+            while (at < size && chars[at] != '\t' && !(chars[at] & 0x80)) {
+                at++;
+            }
+        }
+        if (at == size) {
+            break;
+        }
+        ri += at - cx;
+        rx += at - cx;
+        int len = 1, rlen, w;
+        if (chars[at] == '\t') {
+            rlen = w = KILO_TAB_STOP - rx % KILO_TAB_STOP;
+        } else {
+            w = editorUtf8Width(&chars[at], size - at, &len);
+            // what can't be shown takes one column, see editorPutChar()
+            w = w < 0 ? 1 : w;
+            rlen = len;
+        }
+        if (m) {
+            colChar *c = &m->at[n];
+            c->cx = at, c->ri = ri, c->rx = rx;
+            c->len = len, c->rlen = rlen, c->w = w;
+            m->tabs += (chars[at] == '\t');
+        }
+        n++;
+        cx = at + len;
+        ri += rlen;
+        rx += w;
+    }
+    return n;
+}
+
+// Where the tabs and the characters other than ASCII of `chars` are, and what
+// they take in `render` and on the screen. With that, a position in `chars` is
+// mapped to one in `render` or on the screen (and back) by a binary search
+// instead of a walk from the start of the row. NULL if there are none, every
+// byte is one column then
+colMap *editorColsBuild(const char *chars, int size) {
+    int ascii = (editorAsciiSpan(chars, size) == size);
+    if (ascii && memchr(chars, '\t', size) == NULL) {
+        return NULL;
+    }
+    int n = editorColsWalk(chars, size, ascii, NULL);
+    colMap *m = malloc(sizeof(colMap) + sizeof(colChar) * n);
+    m->n = n;
+    m->tabs = 0;
+    editorColsWalk(chars, size, ascii, m);
+    return m;
+}
+
+// the last character of `m` that starts before index `cx` of `chars`
+colChar *editorColsBefore(colMap *m, int cx) {
+    int lo = 0, hi = m ? m->n : 0;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (m->at[mid].cx < cx) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 ? &m->at[lo - 1] : NULL;
+}
+
+// the last character of `m` that starts at or before column `rx`
+colChar *editorColsAtColumn(colMap *m, int rx) {
+    int lo = 0, hi = m ? m->n : 0;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (m->at[mid].rx <= rx) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 ? &m->at[lo - 1] : NULL;
+}
+
+int editorRowCxToRx(erow *row, int cx) {
+    // the map comes with the view, without it one is built for the call
+    colMap *cols =
+        row->view ? row->view->cols : editorColsBuild(row->chars, row->size);
+    colChar *c = editorColsBefore(cols, cx);
+    int rx = cx;
+    if (c) {
+        // the bytes after it are one column each
+        int end = c->cx + c->len;
+        rx = cx < end ? c->rx : c->rx + c->w + (cx - end);
+    }
+    if (row->view == NULL) {
+        free(cols);
+    }
+    return rx;
+}
+
+int editorRowRxToCx(erow *row, int rx) {
+    colMap *cols =
+        row->view ? row->view->cols : editorColsBuild(row->chars, row->size);
+    colChar *c = editorColsAtColumn(cols, rx);
+    int cx = rx;
+    if (c) {
+        int end = c->rx + c->w;
+        cx = rx < end ? c->cx : c->cx + c->len + (rx - end);
+    }
+    if (row->view == NULL) {
+        free(cols);
+    }
+    return cx < row->size ? cx : row->size;
+}
+
+// the start of the character that ends at index `cx` of `row->chars`
+int editorRowPrevChar(erow *row, int cx) {
+    int at = cx - 1, len;
+    while (at > 0 && cx - at < 4 && (row->chars[at] & 0xc0) == 0x80) {
+        at--;
+    }
+    if (editorUtf8Decode(&row->chars[at], row->size - at, &len) >= 0 &&
+        at + len == cx) {
+        return at;
+    }
+    return cx - 1;
+}
+
+// `cx` moved back to the start of the character it is in
+int editorRowCharStart(erow *row, int cx) {
+    if (cx >= row->size || (row->chars[cx] & 0xc0) != 0x80) {
+        return cx;
+    }
+    // the lead byte of the sequence, if it reaches as far as `cx`
+    for (int at = cx - 1; at >= 0 && cx - at < 4; at--) {
+        if ((row->chars[at] & 0xc0) != 0x80) {
+            int len;
+            if (editorUtf8Decode(&row->chars[at], row->size - at, &len) >= 0 &&
+                at + len > cx) {
+                return at;
+            }
+            break;
+        }
+    }
+    return cx;
+}
+
+// the index of `row->chars` the cursor goes to from `cx` with an arrow key
+// (`dir` is 1 for the right one, -1 for the left one): the next character
+// that takes columns, the zero width ones go with the character before them
+int editorRowStep(erow *row, int cx, int dir) {
+    int len;
+    do {
+        if (dir > 0) {
+            editorUtf8Width(&row->chars[cx], row->size - cx, &len);
+            cx += len;
+        } else {
+            cx = editorRowPrevChar(row, cx);
+        }
+    } while (cx > 0 && cx < row->size &&
+             editorUtf8Width(&row->chars[cx], row->size - cx, &len) == 0);
+    return cx;
+}
+
+// length of the `size` characters of a row once tabs are expanded, with the
+// map of its characters
+int editorRenderLen(int size, colMap *cols) {
+    if (cols == NULL) {
+        return size;
+    }
+    // past the last of them, `render` and `chars` only differ by an offset
+    colChar *c = &cols->at[cols->n - 1];
+    return size + (c->ri + c->rlen) - (c->cx + c->len);
+}
+
+// expand the tabs of `chars` into `render`, which has room for
+// editorRenderLen() characters and the null byte. Returns the rendered length
+int editorRenderText(const char *chars, int size, colMap *cols, char *render) {
+    int cx = 0, ri = 0, tabs = cols ? cols->tabs : 0;
+    for (colChar *c = tabs ? cols->at : NULL; tabs > 0; c++) {
+        if (chars[c->cx] != '\t') {
+            continue;
+        }
+        tabs--;
+        // the text up to the tab as it is, then the tab as spaces
+        memcpy(&render[ri], &chars[cx], c->cx - cx);
+        ri += c->cx - cx;
+        memset(&render[ri], ' ', c->rlen);
+        ri += c->rlen;
+        cx = c->cx + 1;
+    }
+    memcpy(&render[ri], &chars[cx], size - cx);
+    ri += size - cx;
+    render[ri] = '\0';
+    return ri;
+}
+
+// free the view of `row`, it is built again when the row is shown
+void editorRowDropView(erow *row) {
+    rowView *v = row->view;
+    if (v == NULL) {
+        return;
+    }
+    free(v->render);
+    free(v->hl);
+    free(v->cols);
+    free(v);
+    row->view = NULL;
+}
+
+// whether row `at` of E.buf is in the range of a window showing it, only
+// those rows have a view
+int editorRowInView(int at) {
+    for (int i = 0; i < E.num_wins; i++) {
+        editorWindow *w = &E.wins[i];
+        if (w->buf == E.buf && at >= w->view_from && at < w->view_to) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// let only rows [from, to) keep their view as far as E.win is concerned, the
+// ones that leave the range are dropped unless another window shows them
+void editorKeepRows(int from, int to) {
+    editorWindow *w = E.win;
+    if (from < 0) {
+        from = 0;
+    }
+    if (to > E.buf->num_rows) {
+        to = E.buf->num_rows;
+    }
+    if (from == w->view_from && to == w->view_to) {
+        return;
+    }
+    int old_from = w->view_from, old_to = w->view_to;
+    w->view_from = from;
+    w->view_to = to;
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, old_from);
+         row && row->index < old_to; row = editorRowIterNext(&it)) {
+        if (!editorRowInView(row->index)) {
+            editorRowDropView(row);
+        }
+    }
+}
+
+// keep the windows on E.buf around the same rows when `delta` rows are
+// inserted (1) or deleted (-1) at index `at`: the range of rows with a view,
+// and for the windows other than E.win also the cursor and the rows shown
+void editorShiftViews(int at, int delta) {
+    for (int i = 0; i < E.num_wins; i++) {
+        editorWindow *w = &E.wins[i];
+        if (w->buf != E.buf) {
+            continue;
+        }
+        if (at < w->view_from) {
+            w->view_from += delta;
+        }
+        if (at < w->view_to) {
+            w->view_to += delta;
+        }
+        if (w == E.win) {
+            continue;
+        }
+        if (w->cy > at || (w->cy == at && delta > 0)) {
+            w->cy += delta;
+        }
+        if (w->row_off > at || (w->row_off == at && delta > 0)) {
+            w->row_off += delta;
+        }
+    }
+}
+
+// expand tab to spaces
+void editorUpdateRow(erow *row) {
+    // rows away from the screen get no view, they only keep their state
+    if (!editorRowInView(row->index)) {
+        editorRowDropView(row);
+        if (row->index < E.buf->hl_ready) {
+            editorUpdateSyntax(row);
+        }
+        return;
+    }
+    if (row->view == NULL) {
+        row->view = calloc(1, sizeof(rowView));
+    }
+    rowView *v = row->view;
+    free(v->cols);
+    v->cols = editorColsBuild(row->chars, row->size);
+    // the previous `render` and `hl` are reused as long as they are big enough
+    int need = editorRenderLen(row->size, v->cols) + 1;
+    if (v->rcap < need) {
+        v->rcap = editorGrowCap(v->rcap, need);
+        v->render = realloc(v->render, v->rcap);
+        v->hl = realloc(v->hl, v->rcap);
+    }
+    v->rsize = editorRenderText(row->chars, row->size, v->cols, v->render);
+
+    if (row->index < E.buf->hl_ready) {
+        editorUpdateSyntax(row);
+    }
+}
+
+// update `render` and `hl` after a single character that is not a tab was
+// inserted at (`delta` = 1) or deleted from (`delta` = -1) index `cx` of
+// `row->chars`, instead of rebuilding them from scratch. The rendered text
+// before the edit is unchanged, the plain characters between the edit and the
+// next tab just move by one column, and that tab grows or shrinks to reach the
+// same tab stop. If it can't (it was one column wide, or it crosses a stop),
+// everything after it moves by a whole KILO_TAB_STOP and keeps its alignment
+void editorUpdateRowAt(erow *row, int cx, int delta) {
+    // all of that takes one byte to a column, rows with more than ASCII are
+    // simply rendered again
+    rowView *v = row->view;
+    if (v == NULL || (v->cols && v->cols->tabs < v->cols->n) ||
+        (delta > 0 && (row->chars[cx] & 0x80))) {
+        editorUpdateRow(row);
+        return;
+    }
+
+    int ins = delta > 0 ? 1 : 0;
+    int del = delta < 0 ? 1 : 0;
+    int rx0 = editorRowCxToRx(row, cx);
+    int tail = cx + ins; // first character after the edit
+
+    char *tab = memchr(&row->chars[tail], '\t', row->size - tail);
+    int seg = (tab ? tab - row->chars : row->size) - tail;
+    int old_rsize = v->rsize;
+    // the tab's column and where it ends, before and after the edit
+    int p_old = rx0 + del + seg;
+    int p_new = rx0 + ins + seg;
+    int end_old = p_old, end_new = p_new;
+    unsigned char tab_hl = HL_NORMAL;
+    if (tab) {
+        end_old = (p_old / KILO_TAB_STOP + 1) * KILO_TAB_STOP;
+        end_new = (p_new / KILO_TAB_STOP + 1) * KILO_TAB_STOP;
+        tab_hl = v->hl[p_old];
+    }
+    int new_rsize = old_rsize + (end_new - end_old);
+
+    if (v->rcap < new_rsize + 1) {
+        v->rcap = editorGrowCap(v->rcap, new_rsize + 1);
+        v->render = realloc(v->render, v->rcap);
+        v->hl = realloc(v->hl, v->rcap);
+    }
+
+    // move the plain segment and what follows the tab (or the null byte). On
+    // insertion the far part moves first to make room, on deletion the
+    // segment moves first so the far part can't overwrite it
+    if (del) {
+        memmove(&v->render[rx0], &v->render[rx0 + 1], seg);
+        memmove(&v->hl[rx0], &v->hl[rx0 + 1], seg);
+    }
+    memmove(&v->render[end_new], &v->render[end_old],
+            old_rsize - end_old + 1);
+    memmove(&v->hl[end_new], &v->hl[end_old], old_rsize - end_old);
+    if (ins) {
+        memmove(&v->render[rx0 + 1], &v->render[rx0], seg);
+        memmove(&v->hl[rx0 + 1], &v->hl[rx0], seg);
+    }
+    // the tab keeps the highlighting it had before
+    memset(&v->render[p_new], ' ', end_new - p_new);
+    memset(&v->hl[p_new], tab_hl, end_new - p_new);
+    if (ins) {
+        v->render[rx0] = row->chars[cx];
+        v->hl[rx0] = HL_NORMAL;
+    }
+    v->rsize = new_rsize;
+    // the tabs after the edit moved
+    free(v->cols);
+    v->cols = editorColsBuild(row->chars, row->size);
+
+    if (row->index < E.buf->hl_ready) {
+        editorUpdateSyntaxFrom(row, rx0, rx0 + ins);
+    }
+}
+
+// rows point into the buffer's map until they are modified, this checks which
+// kind of memory `row->chars` is
+int editorRowIsMapped(erow *row) { return row->cap == 0; }
+
+// make room for `need` bytes (null byte included) in `row->chars`. A row
+// loaded from the mapping gets its own copy of the characters first, so this
+// has to be called before modifying `row->chars` in place. It also gives the
+// row a new version, which turns away results computed for the old text
+void editorRowReserve(erow *row, int need) {
+    row->version = ++E.version_clock;
+    if (row->cap >= need) {
+        return;
+    }
+    int cap = editorGrowCap(row->cap, need);
+    if (editorRowIsMapped(row)) {
+        char *chars = malloc(cap);
+        memcpy(chars, row->chars, row->size);
+        chars[row->size] = '\0';
+        row->chars = chars;
+    } else {
+        row->chars = realloc(row->chars, cap);
+    }
+    row->cap = cap;
+}
+
+void editorRowDetach(erow *row) { editorRowReserve(row, row->size + 1); }
+
+// highlight rows [from, at) below hl_ready on their own, starting from a
+// guess of the state above them: whatever the row above `from` ended in the
+// last time it was highlighted. That is exact if the syntax has no multi-line
+// comments, otherwise it holds until the highlighting thread reaches these
+// rows. A row is only done again when it changed or the row above it ended
+// differently, so other changes to `hl` (like search matches) stay in place
+void editorPrepareGuessed(int from, int at) {
+    erow *prev = editorRowAt(from - 1);
+    int in_comment = prev ? prev->hl_open_comment : 0;
+    int redo = 0;
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, from); row && row->index < at;
+         row = editorRowIterNext(&it)) {
+        if (row->view == NULL) {
+            editorUpdateRow(row);
+        }
+        rowView *v = row->view;
+        if (redo || v->hl_version <= row->version ||
+            v->hl_version <= E.buf->hl_epoch) {
+            int open = editorHighlightLine(E.buf->syntax, v->render, v->rsize,
+                                           v->hl, 0, -1, in_comment);
+            redo = (open != row->hl_open_comment);
+            row->hl_open_comment = open;
+            v->hl_version = ++E.version_clock;
+        }
+        in_comment = row->hl_open_comment;
+    }
+}
+
+// build `render` and `hl` for rows [from, at). Highlighting a row depends on
+// whether the row above it ends inside a multi-line comment, so the rows are
+// prepared in order starting from the first one that is not ready. If that is
+// far above `from` and the highlighting thread is there to fill the gap (or
+// there is nothing to carry over), only the rows asked for are highlighted.
+// Rows above that only pass on their state and get no view
+void editorPrepareRows(int from, int at) {
+    if (at > E.buf->num_rows) {
+        at = E.buf->num_rows;
+    }
+    editorKeepRows(from - KILO_VIEW_ROWS, at + KILO_VIEW_ROWS);
+    editorSettleStale(at, E.buf->num_rows);
+    // rows that are ready only lack their view, which is highlighted with the
+    // state of the row above as it's built
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, from);
+         row && row->index < at && row->index < E.buf->hl_ready;
+         row = editorRowIterNext(&it)) {
+        if (row->view == NULL) {
+            editorUpdateRow(row);
+        }
+    }
+    if (at - E.buf->hl_ready > KILO_HL_SYNC_ROWS &&
+        (E.hl_thread_on || !editorSyntaxHasState())) {
+        editorPrepareGuessed(from > E.buf->hl_ready ? from : E.buf->hl_ready,
+                             at);
+        return;
+    }
+    for (erow *row = editorRowIterStart(&it, E.buf->hl_ready);
+         row && E.buf->hl_ready < at; row = editorRowIterNext(&it)) {
+        if (row->view == NULL) {
+            editorUpdateRow(row);
+        }
+        E.buf->hl_ready++;
+        editorUpdateSyntax(row);
+    }
+}
+
+void editorInsertRow(int at, char *s, size_t len) {
+    if (at < 0 || at > E.buf->num_rows)
+        return;
+
+    char *undo = editorUndoAdd(UNDO_INSERT, at, 0, len + 1);
+    if (undo) {
+        memcpy(undo, s, len);
+        undo[len] = '\n';
+    }
+
+    // copy the characters before the insertion, `s` may point into a row of
+    // the same leaf which is about to move
+    char *chars = malloc(len + 1);
+    // chars and s don't overlap, so use memcpy instead of memmove
+    memcpy(chars, s, len);
+    chars[len] = '\0';
+
+    // the row indices are not stored anywhere, so nothing after `at` needs
+    // to be renumbered
+    erow *row = editorRowsInsert(at, len);
+    row->size = len;
+    row->cap = len + 1;
+    row->chars = chars;
+
+    row->view = NULL;
+    row->hl_open_comment = 0;
+    row->version = ++E.version_clock;
+    editorShiftViews(at, 1);
+    if (at < E.buf->hl_ready) {
+        E.buf->hl_ready++;
+        editorShiftStale(at, 1);
+        // start out as if the new row passes on the state of the row above
+        // it, so that highlighting it tells whether the rows below it are
+        // affected
+        erow *prev = editorRowAt(at - 1);
+        row = editorRowAt(at);
+        row->hl_open_comment = prev ? prev->hl_open_comment : 0;
+    }
+    editorUpdateRow(row);
+
+    E.buf->dirty++;
+}
+
+void editorFreeRow(erow *row) {
+    editorRowDropView(row);
+    if (!editorRowIsMapped(row)) {
+        free(row->chars);
+    }
+}
+
+void editorDelRow(int at) {
+    if (at < 0 || at >= E.buf->num_rows)
+        return;
+    erow *row = editorRowAt(at);
+    char *undo = editorUndoAdd(UNDO_DELETE, at, 0, row->size + 1);
+    if (undo) {
+        memcpy(undo, row->chars, row->size);
+        undo[row->size] = '\n';
+    }
+    int open_comment = row->hl_open_comment;
+    editorFreeRow(row); // free current row
+    editorRowsDelete(at);
+    editorShiftViews(at, -1);
+    if (at < E.buf->hl_ready) {
+        E.buf->hl_ready--;
+        editorShiftStale(at, -1);
+        // the row that moved up now follows a different row
+        erow *prev = editorRowAt(at - 1);
+        if ((prev ? prev->hl_open_comment : 0) != open_comment) {
+            editorSyntaxPropagate(at);
+        }
+    }
+    E.buf->dirty++;
 }
 
 // insert a character into a row
@@ -643,298 +3617,3526 @@ void editorRowInsertChar(erow *row, int at, int c) {
     if (at < 0 || at > row->size) {
         at = row->size;
     }
-
-    // we add 2 because we also have to make room for the null byte
-    row->chars = realloc(row->chars, row->size + 2);
-    memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
-    row->size++;
-    row->chars[at] = c;
-    editorUpdateRow(row);
-    E.dirty++;
+    editorUndoTyped(row->index, at, (char)c);
+
+    // we add 2 because we also have to make room for the null byte
+    editorRowReserve(row, row->size + 2);
+    memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
+    row->size++;
+    editorRowsResized(row->index, 1);
+    row->chars[at] = c;
+    if (c == '\t') {
+        editorUpdateRow(row);
+    } else {
+        editorUpdateRowAt(row, at, 1);
+    }
+    E.buf->dirty++;
+}
+
+// insert `len` characters at `at` into a row
+void editorRowInsertString(erow *row, int at, const char *s, size_t len) {
+    if (at < 0 || at > row->size) {
+        at = row->size;
+    }
+    editorUndoCopy(UNDO_INSERT, row->index, at, s, len);
+    editorRowReserve(row, row->size + len + 1);
+    memmove(&row->chars[at + len], &row->chars[at], row->size - at + 1);
+    memcpy(&row->chars[at], s, len);
+    row->size += len;
+    editorRowsResized(row->index, len);
+    editorUpdateRow(row);
+    E.buf->dirty++;
+}
+
+// append a string s with length len to a erow row
+void editorRowAppendString(erow *row, char *s, size_t len) {
+    editorUndoCopy(UNDO_INSERT, row->index, row->size, s, len);
+    editorRowReserve(row, row->size + len + 1);
+    memcpy(&row->chars[row->size], s, len);
+    row->size += len;
+    editorRowsResized(row->index, len);
+    row->chars[row->size] = '\0';
+    editorUpdateRow(row);
+    E.buf->dirty++;
+}
+
+void editorRowDelChar(erow *row, int at) {
+    if (at < 0 || at >= row->size) {
+        return;
+    }
+    editorUndoCopy(UNDO_DELETE, row->index, at, &row->chars[at], 1);
+
+    editorRowDetach(row);
+    int was_tab = (row->chars[at] == '\t');
+    memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
+    row->size--;
+    editorRowsResized(row->index, -1);
+    if (was_tab) {
+        editorUpdateRow(row);
+    } else {
+        editorUpdateRowAt(row, at, -1);
+    }
+    E.buf->dirty++;
+}
+
+// delete `len` characters at `at` from a row
+void editorRowDelString(erow *row, int at, int len) {
+    if (at < 0 || len <= 0 || at + len > row->size) {
+        return;
+    }
+    editorUndoCopy(UNDO_DELETE, row->index, at, &row->chars[at], len);
+    editorRowDetach(row);
+    memmove(&row->chars[at], &row->chars[at + len], row->size - at - len + 1);
+    row->size -= len;
+    editorRowsResized(row->index, -len);
+    editorUpdateRow(row);
+    E.buf->dirty++;
+}
+
+/*** highlighting thread ***/
+
+// After a file is opened or its syntax changes, the rows below hl_ready are
+// highlighted by a second thread, one batch of consecutive rows at a time. The
+// main thread posts a job and picks up the result on the next refresh
+// (editorHlThreadSync()), and meanwhile draws such rows with a guess
+// (editorPrepareGuessed()). There is one thread for all buffers, which does
+// the one in front first
+
+#if KILO_HL_THREAD
+
+void editorHlJobFree(hlJob *job) {
+    free(job->rows);
+    free(job->copy);
+    free(job);
+}
+
+// runs in the highlighting thread and only touches the job. The rendered
+// rows are thrown away, what's kept is where the comments are open
+void editorHlJobRun(hlJob *job) {
+    hlScratch scratch = {NULL, NULL, 0};
+    int in_comment = job->in_comment;
+    for (int k = 0; k < job->count; k++) {
+        hlJobRow *r = &job->rows[k];
+        in_comment = editorHighlightScratch(job->syntax, &scratch, r->chars,
+                                            r->size, in_comment);
+        r->hl_open_comment = in_comment;
+    }
+    free(scratch.render);
+    free(scratch.hl);
+}
+
+void *editorHlThreadMain(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&E.hl_lock);
+    while (1) {
+        while (E.hl_job_state != HL_JOB_QUEUED) {
+            pthread_cond_wait(&E.hl_cond, &E.hl_lock);
+        }
+        hlJob *job = E.hl_job;
+        pthread_mutex_unlock(&E.hl_lock);
+        editorHlJobRun(job);
+        pthread_mutex_lock(&E.hl_lock);
+        E.hl_job_state = HL_JOB_DONE;
+        editorWake();
+    }
+    return NULL;
+}
+
+void editorHlThreadStart() {
+    pthread_mutex_init(&E.hl_lock, NULL);
+    pthread_cond_init(&E.hl_cond, NULL);
+    E.hl_job = NULL;
+    E.hl_job_state = HL_JOB_IDLE;
+    // SIGWINCH is blocked in the thread, so the handler runs on the main
+    // thread and interrupts its poll()
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGWINCH);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    // without the thread, rows are highlighted in order as they are shown
+    E.hl_thread_on =
+        (pthread_create(&E.hl_thread, NULL, editorHlThreadMain, NULL) == 0);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+// capture the next KILO_HL_JOB_ROWS rows of E.buf from hl_ready on
+hlJob *editorHlJobNew() {
+    int count = E.buf->num_rows - E.buf->hl_ready;
+    if (count > KILO_HL_JOB_ROWS) {
+        count = KILO_HL_JOB_ROWS;
+    }
+    hlJob *job = malloc(sizeof(hlJob));
+    job->buf = E.buf;
+    job->start = E.buf->hl_ready;
+    job->count = count;
+    job->syntax = E.buf->syntax;
+    job->epoch = E.buf->hl_epoch;
+    erow *prev = editorRowAt(E.buf->hl_ready - 1);
+    job->in_comment = prev ? prev->hl_open_comment : 0;
+    job->rows = malloc(sizeof(hlJobRow) * count);
+
+    // rows that own their characters may be edited while the thread works,
+    // so those are copied into one buffer
+    size_t copy_len = 0;
+    rowIter it;
+    int k = 0;
+    for (erow *row = editorRowIterStart(&it, job->start); row && k < count;
+         row = editorRowIterNext(&it), k++) {
+        if (!editorRowIsMapped(row)) {
+            copy_len += row->size;
+        }
+    }
+    job->copy = malloc(copy_len + 1);
+
+    char *p = job->copy;
+    k = 0;
+    for (erow *row = editorRowIterStart(&it, job->start); row && k < count;
+         row = editorRowIterNext(&it), k++) {
+        hlJobRow *r = &job->rows[k];
+        r->size = row->size;
+        r->version = row->version;
+        if (editorRowIsMapped(row)) {
+            r->chars = row->chars;
+        } else {
+            memcpy(p, row->chars, row->size);
+            r->chars = p;
+            p += row->size;
+        }
+    }
+    return job;
+}
+
+// hand the results of a finished job to the rows of E.buf, which is the
+// buffer the job was for. Only the rows right at
+// hl_ready can take them, as long as the row above agrees on the state the
+// job started from, and only up to the first row that changed since. Rows
+// that have a view are highlighted again with the state they now start in
+void editorHlJobMerge(hlJob *job) {
+    int k = E.buf->hl_ready - job->start;
+    if (job->epoch != E.buf->hl_epoch || job->syntax != E.buf->syntax ||
+        k < 0 || k >= job->count) {
+        return;
+    }
+    erow *prev = editorRowAt(E.buf->hl_ready - 1);
+    int in_comment = k > 0 ? job->rows[k - 1].hl_open_comment : job->in_comment;
+    if ((prev ? prev->hl_open_comment : 0) != in_comment) {
+        return;
+    }
+
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, E.buf->hl_ready);
+         row && k < job->count; row = editorRowIterNext(&it), k++) {
+        hlJobRow *r = &job->rows[k];
+        if (row->version != r->version) {
+            break;
+        }
+        rowView *v = row->view;
+        if (v) {
+            editorHighlightLine(E.buf->syntax, v->render, v->rsize, v->hl, 0,
+                                -1, in_comment);
+        }
+        row->hl_open_comment = in_comment = r->hl_open_comment;
+        E.buf->hl_ready++;
+    }
+}
+
+// take over what the thread has finished and give it the next rows. The
+// thread only holds the lock to pick up and finish jobs, so this never waits
+// for long
+void editorHlThreadSync() {
+    if (!E.hl_thread_on) {
+        return;
+    }
+    editorBuffer *buf = E.buf;
+    pthread_mutex_lock(&E.hl_lock);
+    if (E.hl_job_state == HL_JOB_DONE) {
+        E.buf = E.hl_job->buf;
+        editorHlJobMerge(E.hl_job);
+        E.buf = buf;
+        editorHlJobFree(E.hl_job);
+        E.hl_job = NULL;
+        E.hl_job_state = HL_JOB_IDLE;
+    }
+    if (E.hl_job_state == HL_JOB_IDLE) {
+        if (E.map_retired) {
+            munmap(E.map_retired, E.map_retired_len);
+            E.map_retired = NULL;
+            E.map_retired_len = 0;
+        }
+        // the buffer in front first, then the others on the screen
+        for (int i = -1; i < E.num_wins && E.hl_job == NULL; i++) {
+            E.buf = i < 0 ? buf : E.wins[i].buf;
+            if (editorSyntaxHasState() && E.buf->hl_ready < E.buf->num_rows) {
+                E.hl_job = editorHlJobNew();
+                E.hl_job_state = HL_JOB_QUEUED;
+                pthread_cond_signal(&E.hl_cond);
+            }
+        }
+        E.buf = buf;
+    }
+    pthread_mutex_unlock(&E.hl_lock);
+}
+
+// whether a finished job is waiting for editorHlThreadSync()
+int editorHlThreadDone() {
+    if (!E.hl_thread_on) {
+        return 0;
+    }
+    pthread_mutex_lock(&E.hl_lock);
+    int done = (E.hl_job_state == HL_JOB_DONE);
+    pthread_mutex_unlock(&E.hl_lock);
+    return done;
+}
+
+#else
+
+void editorHlThreadStart() { E.hl_thread_on = 0; }
+void editorHlThreadSync() {}
+int editorHlThreadDone() { return 0; }
+
+#endif
+
+/*** thread pool ***/
+
+// Searching and replacing over the whole file is split into chunks of rows
+// that the threads of the pool take one by one, so a thread that is done
+// early just takes the next chunk instead of waiting for the others. The
+// main thread works on the task as well and returns once every chunk is done
+
+// take chunks of `task` until there are none left
+void editorPoolWork(poolTask *task, int worker) {
+    int chunk;
+    while ((chunk = __atomic_fetch_add(&task->next, 1, __ATOMIC_RELAXED)) <
+           task->chunks) {
+        task->run(task->arg, chunk, worker);
+    }
+}
+
+// the number of threads to use, from the KILO_THREADS environment variable
+void editorPoolInit() {
+    long n = 0;
+    char *env = getenv("KILO_THREADS");
+    if (env) {
+        n = strtol(env, NULL, 10);
+    }
+    if (n <= 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (n > KILO_POOL_MAX) {
+        n = KILO_POOL_MAX;
+    }
+    E.pool_size = (KILO_HL_THREAD && n > 1) ? n : 1;
+    E.pool_started = 0;
+    E.pool_task = NULL;
+    E.pool_generation = 0;
+}
+
+#if KILO_HL_THREAD
+
+void *editorPoolMain(void *arg) {
+    int worker = (int)(long)arg;
+    unsigned int seen = 0;
+    pthread_mutex_lock(&E.pool_lock);
+    while (1) {
+        // a task that was over before this thread woke up is skipped
+        while (E.pool_generation == seen || E.pool_task == NULL) {
+            seen = E.pool_generation;
+            pthread_cond_wait(&E.pool_cond, &E.pool_lock);
+        }
+        seen = E.pool_generation;
+        poolTask *task = E.pool_task;
+        task->active++;
+        pthread_mutex_unlock(&E.pool_lock);
+        editorPoolWork(task, worker);
+        pthread_mutex_lock(&E.pool_lock);
+        if (--task->active == 0) {
+            pthread_cond_signal(&E.pool_idle);
+        }
+    }
+    return NULL;
+}
+
+void editorPoolStart() {
+    pthread_mutex_init(&E.pool_lock, NULL);
+    pthread_cond_init(&E.pool_cond, NULL);
+    pthread_cond_init(&E.pool_idle, NULL);
+    // like the highlighting thread, the workers leave SIGWINCH to the main
+    // thread
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGWINCH);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int started = 1;
+    for (int k = 1; k < E.pool_size; k++) {
+        if (pthread_create(&E.pool_threads[k], NULL, editorPoolMain,
+                           (void *)(long)k) == 0) {
+            started++;
+        } else {
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    E.pool_size = started;
+    E.pool_started = 1;
+}
+
+// run every chunk of `task` and return when they are all done. The workers
+// only write to what `run` gives them, taking the lock when they leave makes
+// it visible to the main thread
+void editorPoolRun(poolTask *task) {
+    task->next = 0;
+    task->active = 0;
+    if (task->chunks > 1 && E.pool_size > 1) {
+        if (!E.pool_started) {
+            editorPoolStart();
+        }
+        pthread_mutex_lock(&E.pool_lock);
+        E.pool_task = task;
+        E.pool_generation++;
+        pthread_cond_broadcast(&E.pool_cond);
+        pthread_mutex_unlock(&E.pool_lock);
+    }
+    editorPoolWork(task, 0);
+    if (E.pool_task) {
+        pthread_mutex_lock(&E.pool_lock);
+        while (task->active > 0) {
+            pthread_cond_wait(&E.pool_idle, &E.pool_lock);
+        }
+        E.pool_task = NULL;
+        pthread_mutex_unlock(&E.pool_lock);
+    }
+}
+
+#else
+
+void editorPoolRun(poolTask *task) {
+    for (int chunk = 0; chunk < task->chunks; chunk++) {
+        task->run(task->arg, chunk, 0);
+    }
+}
+
+#endif
+
+/*** editor operations ***/
+
+void editorInsertChar(int c) {
+    // if the cursor is on the tilde line after the end of the file
+    if (E.win->cy == E.buf->num_rows) {
+        editorInsertRow(E.buf->num_rows, "", 0);
+    }
+    editorRowInsertChar(editorRowAt(E.win->cy), E.win->cx, c);
+    E.win->cx++;
+}
+
+void editorInsertNewline() {
+    // insert a new blank row before the line we are on
+    if (E.win->cx == 0) {
+        editorInsertRow(E.win->cy, "", 0);
+    } else {
+        // insert a new line and truncate current line. For undo that is just
+        // a newline, not the rest of the line moving to a new row
+        editorUndoCopy(UNDO_INSERT, E.win->cy, E.win->cx, "\n", 1);
+        E.buf->undo.paused++;
+        erow *row = editorRowAt(E.win->cy);
+        editorInsertRow(E.win->cy + 1, &row->chars[E.win->cx],
+                        row->size - E.win->cx);
+        E.buf->undo.paused--;
+        row = editorRowAt(E.win->cy);
+        editorRowDetach(row);
+        // the row keeps its capacity for the text that will be typed next
+        editorRowsResized(E.win->cy, E.win->cx - row->size);
+        row->size = E.win->cx;
+        row->chars[row->size] = '\0';
+        editorUpdateRow(row);
+    }
+    // reposition the cursor
+    E.win->cy++;
+    E.win->cx = 0;
+}
+
+// insert text at the cursor as one edit and put the cursor after it. The
+// first line goes into the cursor's row, which is split there, every further
+// line is a new row, and the last one goes in front of the rest of the split
+// row
+void editorInsertText(const char *s, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    if (E.win->cy == E.buf->num_rows) {
+        editorInsertRow(E.buf->num_rows, "", 0);
+    }
+    const char *nl = memchr(s, '\n', len);
+    size_t first = nl ? (size_t)(nl - s) : len;
+    editorRowInsertString(editorRowAt(E.win->cy), E.win->cx, s, first);
+    E.win->cx += first;
+    if (nl == NULL) {
+        return;
+    }
+    editorInsertNewline();
+
+    const char *p = nl + 1, *end = s + len;
+    while ((nl = memchr(p, '\n', end - p)) != NULL) {
+        editorInsertRow(E.win->cy, (char *)p, nl - p);
+        E.win->cy++;
+        p = nl + 1;
+    }
+    editorRowInsertString(editorRowAt(E.win->cy), 0, p, end - p);
+    E.win->cx = end - p;
+}
+
+void editorDelChar() {
+    if (E.win->cy == E.buf->num_rows)
+        return;
+    if (E.win->cx == 0 && E.win->cy == 0)
+        return;
+
+    erow *row = editorRowAt(E.win->cy);
+    if (E.win->cx > 0) {
+        // the whole character before the cursor
+        int at = editorRowPrevChar(row, E.win->cx);
+        if (at == E.win->cx - 1) {
+            editorRowDelChar(row, at);
+        } else {
+            editorRowDelString(row, at, E.win->cx - at);
+        }
+        E.win->cx = at;
+    }
+    // if cx == 0,
+    // append current row to previous row, and then delete current row
+    else {
+        erow *prev = editorRowAt(E.win->cy - 1);
+        E.win->cx = prev->size;
+        // the newline between the rows is all that goes
+        editorUndoCopy(UNDO_DELETE, E.win->cy - 1, E.win->cx, "\n", 1);
+        E.buf->undo.paused++;
+        editorRowAppendString(prev, row->chars, row->size);
+        editorDelRow(E.win->cy);
+        E.buf->undo.paused--;
+        E.win->cy--;
+    }
+}
+
+// insert the `len` bytes at `s` at position `x` of row `y`, as an undo
+// record describes it. Newlines split the row, and past the last row every
+// line is a new row
+void editorTextInsert(int y, int x, const char *s, int len) {
+    const char *p = s, *end = s + len;
+    if (y == E.buf->num_rows) {
+        while (p < end) {
+            const char *nl = memchr(p, '\n', end - p);
+            const char *line_end = nl ? nl : end;
+            editorInsertRow(y++, (char *)p, line_end - p);
+            p = line_end + 1;
+        }
+        return;
+    }
+    erow *row = editorRowAt(y);
+    const char *last = end;
+    while (last > s && last[-1] != '\n') {
+        last--;
+    }
+    if (last == s) {
+        editorRowInsertString(row, x, s, len);
+        return;
+    }
+    // the rest of the row goes after the last line
+    struct abuf tail = ABUF_INIT;
+    abReserve(&tail, (end - last) + (row->size - x) + 1);
+    abAppend(&tail, last, end - last);
+    abAppend(&tail, &row->chars[x], row->size - x);
+    editorRowDelString(row, x, row->size - x);
+    const char *nl = memchr(p, '\n', end - p);
+    editorRowAppendString(row, (char *)p, nl - p);
+    p = nl + 1;
+    while (p < last) {
+        nl = memchr(p, '\n', end - p);
+        editorInsertRow(++y, (char *)p, nl - p);
+        p = nl + 1;
+    }
+    editorInsertRow(y + 1, tail.b, tail.len);
+    abFree(&tail);
+}
+
+// delete `len` bytes from position `x` of row `y` on, as an undo record
+// describes it. A newline among them joins the rows around it
+void editorTextDelete(int y, int x, int len) {
+    // whole rows
+    while (x == 0 && y < E.buf->num_rows && len > editorRowAt(y)->size) {
+        len -= editorRowAt(y)->size + 1;
+        editorDelRow(y);
+    }
+    erow *row = editorRowAt(y);
+    if (len == 0 || row == NULL) {
+        return;
+    }
+    if (x + len <= row->size) {
+        editorRowDelString(row, x, len);
+        return;
+    }
+    // the rest of the row with its newline, the rows after it, and the start
+    // of the row that is joined to it
+    len -= row->size - x + 1;
+    editorRowDelString(row, x, row->size - x);
+    while (y + 1 < E.buf->num_rows && len > editorRowAt(y + 1)->size) {
+        len -= editorRowAt(y + 1)->size + 1;
+        editorDelRow(y + 1);
+    }
+    erow *next = editorRowAt(y + 1);
+    if (next) {
+        editorRowAppendString(editorRowAt(y), &next->chars[len],
+                              next->size - len);
+        editorDelRow(y + 1);
+    }
+}
+
+// make the change of `r` again (`forward`) or take it back, and put the
+// cursor where it happened
+void editorUndoApply(undoRecord *r, int forward) {
+    E.win->cy = r->y;
+    E.win->cx = r->x;
+    if ((r->type == UNDO_INSERT) != forward) {
+        editorTextDelete(r->y, r->x, r->len);
+        return;
+    }
+    editorTextInsert(r->y, r->x, r->bytes, r->len);
+    // after the inserted text
+    for (int i = 0; i < r->len; i++) {
+        if (r->bytes[i] == '\n') {
+            E.win->cy++;
+            E.win->cx = 0;
+        } else {
+            E.win->cx++;
+        }
+    }
+}
+
+// keep the cursor inside the file after the rows changed under it
+void editorClampCursor() {
+    if (E.win->cy > E.buf->num_rows) {
+        E.win->cy = E.buf->num_rows;
+    }
+    erow *row = editorRowAt(E.win->cy);
+    int row_len = row ? row->size : 0;
+    if (E.win->cx > row_len) {
+        E.win->cx = row_len;
+    }
+    if (row) {
+        E.win->cx = editorRowCharStart(row, E.win->cx);
+    }
+}
+
+// take back the last step, and put the cursor where it was before it
+void editorUndo() {
+    undoLog *U = &E.buf->undo;
+    if (U->at == 0) {
+        editorSetStatusMessage("Nothing to undo");
+        return;
+    }
+    unsigned int step = U->records[U->at - 1].step;
+    undoRecord *r;
+    U->paused++;
+    do {
+        r = &U->records[--U->at];
+        editorUndoApply(r, 0);
+    } while (U->at > 0 && U->records[U->at - 1].step == step);
+    U->paused--;
+    E.win->cy = r->cy;
+    E.win->cx = r->cx;
+    editorClampCursor();
+}
+
+// make the step that was taken back last again
+void editorRedo() {
+    undoLog *U = &E.buf->undo;
+    if (U->at == U->len) {
+        editorSetStatusMessage("Nothing to redo");
+        return;
+    }
+    unsigned int step = U->records[U->at].step;
+    U->paused++;
+    do {
+        editorUndoApply(&U->records[U->at++], 1);
+    } while (U->at < U->len && U->records[U->at].step == step);
+    U->paused--;
+    editorClampCursor();
+}
+
+// move the cursor to a line, or with '@' in front to a byte offset of the
+// file (in decimal, or in hex after 0x) as tools that read the file report
+// them, and show it in the middle of the screen
+void editorGoTo() {
+    char *query =
+        editorPrompt("Go to line: %s (@ for a byte offset, ESC to cancel)",
+                     NULL, 0);
+    if (query == NULL) {
+        return;
+    }
+    int is_offset = (query[0] == '@');
+    char *digits = &query[is_offset], *end;
+    long long n = strtoll(digits, &end, is_offset ? 0 : 10);
+    if (end == digits || *end != '\0' || n < 0) {
+        editorSetStatusMessage("Not a %s: %s",
+                               is_offset ? "byte offset" : "line number",
+                               digits);
+        free(query);
+        return;
+    }
+    if (is_offset) {
+        E.win->cy = editorRowAtOffset(n, &E.win->cx);
+    } else {
+        E.win->cy = n > E.buf->num_rows ? E.buf->num_rows - 1 : (int)n - 1;
+        if (E.win->cy < 0) {
+            E.win->cy = 0;
+        }
+        E.win->cx = 0;
+    }
+    // a byte offset may fall inside a character
+    editorClampCursor();
+    E.win->row_off = E.win->cy - E.win->screen_rows / 2;
+    if (E.win->row_off < 0) {
+        E.win->row_off = 0;
+    }
+    free(query);
+}
+
+/*** file I/O ***/
+
+// add up the lengths of each row of text, adding 1 to each one for the newline
+// character we'll add to the end of each line
+long long editorRowsLength() {
+    long long tot_len = 0;
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, 0); row;
+         row = editorRowIterNext(&it)) {
+        tot_len += row->size + 1; // add one for '\n'
+    }
+    return tot_len;
+}
+
+// write all of `iov` to `fd`, going on after a short write. Returns -1 on
+// error
+int editorWritev(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+// tell the main thread how far the write got, and stop if it asked to
+int editorWriterProgress(fileWriter *w) {
+    if (w->progress) {
+        __atomic_store_n(w->progress, w->written, __ATOMIC_RELAXED);
+    }
+    if (w->cancel && __atomic_load_n(w->cancel, __ATOMIC_RELAXED)) {
+        errno = ECANCELED;
+        return -1;
+    }
+    return 0;
+}
+
+// write out the pieces gathered by `w` so far
+int editorWriterFlush(fileWriter *w) {
+    int r = editorWritev(w->fd, w->iov, w->count);
+    w->count = 0;
+    return r == -1 ? -1 : editorWriterProgress(w);
+}
+
+// queue `len` bytes at `p` to be written. They must stay where they are until
+// the next editorWriterFlush()
+int editorWriterAppend(fileWriter *w, const char *p, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (w->count == KILO_IOV_BATCH && editorWriterFlush(w) == -1) {
+        return -1;
+    }
+    w->iov[w->count++] = (struct iovec){(void *)p, len};
+    w->written += len;
+    return 0;
+}
+
+// copy `len` bytes of the mapped file from `offset` on to the file being
+// written, inside the kernel. Returns 0 if that is not possible here (and
+// nothing was copied), -1 on error
+int editorCopyFromFile(fileWriter *w, off_t offset, size_t len) {
+#ifdef __linux__
+    size_t done = 0;
+    while (done < len) {
+        size_t want = len - done;
+        if (want > KILO_COPY_SLICE) {
+            want = KILO_COPY_SLICE;
+        }
+        ssize_t n = copy_file_range(w->copy_fd, &offset, w->fd, NULL, want, 0);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // another file system, or a kernel without it
+            if (done == 0 && (n == 0 || errno == EXDEV || errno == EINVAL ||
+                              errno == ENOSYS || errno == EOPNOTSUPP)) {
+                return 0;
+            }
+            return -1;
+        }
+        done += n;
+        w->written += n;
+        if (editorWriterProgress(w) == -1) {
+            return -1;
+        }
+    }
+    return 1;
+#else
+    (void)w;
+    (void)offset;
+    (void)len;
+    return 0;
+#endif
+}
+
+// write `len` bytes of the mapping `map` from `offset` on. A large piece is
+// copied from the mapped file by the kernel, so it never passes through user
+// space
+int editorWriterMapped(fileWriter *w, const char *map, size_t offset,
+                       size_t len) {
+    if (w->copy_fd != -1 && len >= KILO_COPY_MIN) {
+        if (editorWriterFlush(w) == -1) {
+            return -1;
+        }
+        int copied = editorCopyFromFile(w, offset, len);
+        if (copied != 0) {
+            return copied;
+        }
+        w->copy_fd = -1;
+    }
+    return editorWriterAppend(w, map + offset, len);
+}
+
+void editorWriterInit(fileWriter *w, int fd) {
+    w->fd = fd;
+    w->count = 0;
+    w->written = 0;
+    w->copy_fd = -1;
+    w->progress = NULL;
+    w->cancel = NULL;
+}
+
+// Write every row followed by a newline to `fd`, for rows that don't refer to
+// the file anymore (see editorReleaseMap()). Returns the number of bytes
+// written or -1 on error
+long long editorRowsWrite(int fd) {
+    fileWriter w;
+    editorWriterInit(&w, fd);
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, 0); row;
+         row = editorRowIterNext(&it)) {
+        if (editorWriterAppend(&w, row->chars, row->size) == -1 ||
+            editorWriterAppend(&w, "\n", 1) == -1) {
+            return -1;
+        }
+    }
+    if (editorWriterFlush(&w) == -1) {
+        return -1;
+    }
+    return w.written;
+}
+
+// add a piece to the snapshot of `job`, or extend the last one if it goes on
+// right where that ends
+void editorSnapshotAdd(saveJob *job, int mapped, size_t off, size_t len) {
+    job->total += len;
+    if (job->len > 0) {
+        savePiece *last = &job->pieces[job->len - 1];
+        if (last->mapped == mapped && last->off + last->len == off) {
+            last->len += len;
+            return;
+        }
+    }
+    if (job->len == job->cap) {
+        job->cap = editorGrowCap(job->cap, job->len + 1);
+        job->pieces = realloc(job->pieces, sizeof(savePiece) * job->cap);
+    }
+    job->pieces[job->len++] = (savePiece){mapped, off, len};
+}
+
+// copy `len` bytes at `p` into the snapshot of `job`
+void editorSnapshotCopy(saveJob *job, const char *p, size_t len) {
+    if (job->copy_len + len > job->copy_cap) {
+        // the edited lines may add up to more than an int holds
+        size_t cap = job->copy_cap ? job->copy_cap : 4096;
+        while (cap < job->copy_len + len) {
+            cap *= 2;
+        }
+        job->copy = realloc(job->copy, cap);
+        job->copy_cap = cap;
+    }
+    memcpy(&job->copy[job->copy_len], p, len);
+    editorSnapshotAdd(job, 0, job->copy_len, len);
+    job->copy_len += len;
+}
+
+// Capture what the file is going to hold, so that the rows can go on changing
+// while it is written. Rows that still point into the mapping keep doing so,
+// and lie one after the other there, newlines included, so a file with a few
+// edits is a few pieces of the mapping and a few copied lines
+void editorSnapshotTake(saveJob *job) {
+    job->map = E.buf->map;
+    job->map_fd = E.buf->map_fd;
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, 0); row;
+         row = editorRowIterNext(&it)) {
+        if (!editorRowIsMapped(row)) {
+            editorSnapshotCopy(job, row->chars, row->size);
+            editorSnapshotCopy(job, "\n", 1);
+            continue;
+        }
+        char *end = row->chars + row->size;
+        if (end < E.buf->map + E.buf->map_len && *end == '\n') {
+            editorSnapshotAdd(job, 1, row->chars - E.buf->map, row->size + 1);
+        } else {
+            // the line ended in "\r\n", or was the last one without a newline
+            editorSnapshotAdd(job, 1, row->chars - E.buf->map, row->size);
+            editorSnapshotCopy(job, "\n", 1);
+        }
+    }
+}
+
+// write the snapshot of `job` to its file. Returns the number of bytes
+// written or -1 on error
+long long editorSnapshotWrite(saveJob *job) {
+    fileWriter w;
+    editorWriterInit(&w, job->fd);
+    w.copy_fd = job->map_fd;
+    w.progress = &job->written;
+    w.cancel = &job->cancel;
+    for (int i = 0; i < job->len; i++) {
+        savePiece *piece = &job->pieces[i];
+        int r = piece->mapped
+                    ? editorWriterMapped(&w, job->map, piece->off, piece->len)
+                    : editorWriterAppend(&w, &job->copy[piece->off],
+                                         piece->len);
+        if (r == -1) {
+            return -1;
+        }
+    }
+    if (editorWriterFlush(&w) == -1) {
+        return -1;
+    }
+    return w.written;
+}
+
+// add a row of `size` characters at `chars` to the rows of a file being
+// loaded. Whole leaves are filled and each one is hung into the tree once it
+// is full, instead of inserting the rows one by one
+void editorLoadRow(rowLeaf **leaf, char *chars, size_t size, int open) {
+    if (*leaf == NULL) {
+        *leaf = rowLeafNew();
+    }
+    erow *row = &(*leaf)->rows[(*leaf)->n++];
+    row->size = size;
+    row->cap = 0;
+    row->chars = chars;
+    row->view = NULL;
+    row->hl_open_comment = open;
+    row->version = ++E.version_clock;
+    if ((*leaf)->n == ROW_LEAF_MAX) {
+        editorRowsAppendLeaf(*leaf);
+        *leaf = NULL;
+    }
+}
+
+// split the mapped file into rows. Every row points into the mapping, nothing
+// is copied and no `render` or `hl` is built until the row is shown, so the
+// cost is a memchr() over the file plus one erow per line
+void editorLoadMapped(char *map, size_t map_len) {
+    E.buf->map = map;
+    E.buf->map_len = map_len;
+
+    rowLeaf *leaf = NULL;
+    char *p = map, *end = map + map_len;
+    while (p < end) {
+        char *nl = memchr(p, '\n', end - p);
+        char *line_end = nl ? nl : end;
+        size_t line_len = line_end - p;
+        if (line_len > 0 && p[line_len - 1] == '\r') {
+            line_len--;
+        }
+        editorLoadRow(&leaf, p, line_len, 0);
+        p = line_end + 1;
+    }
+    if (leaf) {
+        editorRowsAppendLeaf(leaf);
+    }
+}
+
+// copy the mapping to the heap in one piece, point the rows that still refer
+// to it at the copy and drop the mapping. Needed before the file is
+// overwritten in place, since the mapped pages would change under our feet
+void editorReleaseMap() {
+    if (E.buf->map == NULL || E.buf->map_fd == -1) {
+        return;
+    }
+    char *copy = malloc(E.buf->map_len);
+    if (copy == NULL) {
+        die("malloc");
+    }
+    memcpy(copy, E.buf->map, E.buf->map_len);
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, 0); row;
+         row = editorRowIterNext(&it)) {
+        if (editorRowIsMapped(row)) {
+            row->chars = copy + (row->chars - E.buf->map);
+        }
+    }
+    if (E.hl_job && E.hl_job->buf == E.buf) {
+        // the highlighting thread may be reading from it. The text it has
+        // is the same as in the copy, so its results still hold
+        E.map_retired = E.buf->map;
+        E.map_retired_len = E.buf->map_mapped;
+    } else {
+        munmap(E.buf->map, E.buf->map_mapped);
+    }
+    close(E.buf->map_fd);
+    E.buf->map = copy;
+    E.buf->map_fd = -1;
+}
+
+// put pages of zeros over the pages of a mapping from `from` up to `to`, both
+// page aligned. They replace the file's pages in place, so whatever reads
+// them meanwhile reads zeros instead of faulting
+void editorMapZero(char *from, char *to) {
+    if (from < to) {
+        mmap(from, to - from, PROT_READ,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    }
+}
+
+// `n` rounded up to whole pages
+size_t editorPageUp(size_t n) {
+    return (n + E.page_size - 1) / E.page_size * E.page_size;
+}
+
+// A page of a mapped file that someone else cut off by truncating the file
+// can't be read anymore, reading it raises SIGBUS. Whichever thread did (the
+// main one, the highlighting thread or one of the pool) gets a page of zeros
+// there instead and goes on, editorMapCheck() sorts out the rows before the
+// next frame. A SIGBUS anywhere else kills the editor as it would without the
+// handler
+void editorMapFault(int sig, siginfo_t *info, void *context) {
+    (void)context;
+    char *addr = info->si_addr;
+    char *page = (char *)((uintptr_t)addr / E.page_size * E.page_size);
+    for (int i = -1; i < E.num_bufs; i++) {
+        char *map = i < 0 ? E.map_retired : E.bufs[i]->map;
+        size_t len = i < 0 ? E.map_retired_len : E.bufs[i]->map_mapped;
+        if (map && (i < 0 || E.bufs[i]->map_fd != -1) && addr >= map &&
+            addr < map + len) {
+            editorMapZero(page, page + E.page_size);
+            return;
+        }
+    }
+    signal(sig, SIG_DFL);
+}
+
+// The file mapped by E.buf was truncated to `size` bytes by someone else. The
+// pages past the new end are replaced with zeros right away. Then a buffer
+// without changes is split into rows again from what the file holds now,
+// which for a followed file is where it goes on from. A buffer with changes
+// keeps them, but its lines past the new end lost their text, the status bar
+// says how many. Nothing is copied over from the mapping either way. While
+// the search prompt holds on to the rows, they stay as they are (reading
+// zeros) until it is closed
+void editorMapShrunk(size_t size) {
+    editorBuffer *b = E.buf;
+    editorMapZero(b->map + editorPageUp(size),
+                  b->map + editorPageUp(b->map_mapped));
+    if (b->search.active) {
+        return;
+    }
+    if (b->dirty == 0) {
+        for (rowLeaf *leaf = b->rows_head, *next; leaf; leaf = next) {
+            for (int i = 0; i < leaf->n; i++) {
+                editorFreeRow(&leaf->rows[i]);
+            }
+            next = leaf->next;
+            free(leaf);
+        }
+        b->rows = b->rows_head = b->rows_tail = NULL;
+        b->num_rows = 0;
+        editorUndoClear();
+        editorLoadMapped(b->map, size);
+        b->file_size = size;
+        b->hl_ready = 0;
+        b->hl_stale_len = 0;
+        b->hl_epoch = ++E.version_clock;
+        b->cache_wanted = 0;
+        if (b->follow.fd != -1) {
+            b->follow.off = size;
+            b->follow.partial = size > 0 && b->map[size - 1] != '\n';
+        }
+        editorSetStatusMessage("%.40s was truncated, reloaded", b->file_name);
+    } else {
+        // each row keeps what of it is still in the file, and gets a copy of
+        // that, so no row reaches past `map_len`
+        int lost = 0, first = -1;
+        rowIter it;
+        for (erow *row = editorRowIterStart(&it, 0); row;
+             row = editorRowIterNext(&it)) {
+            long long keep = b->map + size - row->chars;
+            if (!editorRowIsMapped(row) || keep >= row->size) {
+                continue;
+            }
+            int old = row->size;
+            row->size = keep > 0 ? keep : 0;
+            editorRowDetach(row);
+            row->chars[row->size] = '\0';
+            editorRowsResized(row->index, row->size - old);
+            editorUpdateRow(row);
+            if (lost++ == 0) {
+                first = row->index;
+            }
+        }
+        // the rows after the first one that changed may end in other comment
+        // states now
+        if (first >= 0 && first < b->hl_ready) {
+            b->hl_ready = first;
+        }
+        b->map_len = size;
+        b->dirty++;
+        editorSetStatusMessage("%.40s was truncated, %d lines lost their text",
+                               b->file_name, lost);
+    }
+    // the cursors stay on rows that are there
+    editorWindow *win = E.win;
+    for (int i = 0; i < E.num_wins; i++) {
+        if (E.wins[i].buf == b) {
+            E.win = &E.wins[i];
+            if (b->dirty == 0) {
+                E.win->view_from = E.win->view_to = 0;
+            }
+            editorClampCursor();
+        }
+    }
+    E.win = win;
+}
+
+// look at the size of every mapped file, in case someone else truncated one,
+// see editorMapShrunk(). Returns whether one was
+int editorMapCheck() {
+    editorBuffer *buf = E.buf;
+    int shrunk = 0;
+    for (int i = 0; i < E.num_bufs; i++) {
+        E.buf = E.bufs[i];
+        struct stat st;
+        if (E.buf->map_fd != -1 && fstat(E.buf->map_fd, &st) == 0 &&
+            (size_t)st.st_size < E.buf->map_len) {
+            editorMapShrunk(st.st_size);
+            shrunk = 1;
+        }
+    }
+    E.buf = buf;
+    return shrunk;
+}
+
+// it will open and read a file from the disk
+void editorOpen(char *file_name) {
+    free(E.buf->file_name); // We may open more than one file at the same time
+    E.buf->file_name = strdup(file_name); // strdup: save a copy of a string
+
+    editorSelectSyntaxHighlight();
+    // there is nothing to undo in a file that was just opened
+    editorUndoClear();
+
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1)
+        die("open");
+
+    // regular files are mapped instead of read, so opening a huge file costs
+    // little more than finding its line breaks
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            // the descriptor is kept for copying from the file when saving
+            E.buf->map_fd = fd;
+            E.buf->map_mapped = st.st_size;
+            E.buf->file_size = st.st_size;
+            // a large file that was opened before may have a cache, or get
+            // one
+            int cached = 0;
+            E.buf->cache_wanted = 0;
+            if (st.st_size >= KILO_CACHE_MIN) {
+                editorCacheKey(map, &st);
+                cached = editorCacheLoad(map, st.st_size);
+                E.buf->cache_wanted = !cached;
+            }
+            if (!cached) {
+                editorLoadMapped(map, st.st_size);
+            }
+            E.buf->dirty = 0;
+            return;
+        }
+    }
+
+    // anything else is read into one buffer on the heap, which the rows point
+    // into just like into a mapping
+    size_t len = 0, cap = 64 * 1024;
+    char *buf = malloc(cap);
+    ssize_t n;
+    while ((n = read(fd, buf + len, cap - len)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            die("read");
+        }
+        len += n;
+        if (len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    close(fd);
+    E.buf->file_size = len;
+    if (len == 0) {
+        free(buf);
+    } else {
+        editorLoadMapped(buf, len);
+    }
+    E.buf->dirty = 0;
+}
+
+// the old way of saving: overwrite the file in place. Only used where the
+// file can't be replaced, see editorSaveStart(), and it blocks until it is
+// done
+long long editorSaveInPlace(const char *path) {
+    // the rows must stop referring to the file before it changes, which
+    // copies all of the mapping to the heap (the size of the file, once) and
+    // makes this slow on a large file
+    editorReleaseMap();
+    long long len = editorRowsLength();
+    // open for reading and writing. create if not exists
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    // Sets the file's size to the specified length. If the file is larger
+    //  than that, it will cut off any data at the end of the file to make
+    //  it that length. If the file is shorter, it will add `0` bytes at
+    //  the end to make it that length.
+    if (ftruncate(fd, len) == -1 || editorRowsWrite(fd) != len) {
+        close(fd);
+        return -1;
+    }
+    return close(fd) == -1 ? -1 : len;
+}
+
+// tell how a save that started at `start` went. Only the `dirty` changes
+// made before it started are saved, any made since still are not
+void editorSaveDone(long long len, int error, long long start, int dirty) {
+    if (len == -1) {
+        if (error == ECANCELED) {
+            editorSetStatusMessage("Save cancelled");
+        } else {
+            editorSetStatusMessage("Can't save! I/O error: %s",
+                                   strerror(error));
+        }
+        return;
+    }
+    E.buf->dirty -= dirty;
+    E.buf->file_size = len;
+    long long ms = editorNowMs() - start;
+    if (ms > 0) {
+        editorSetStatusMessage("%lld bytes written to disk in %lld ms "
+                               "(%lld MB/s)",
+                               len, ms, len / 1000 / ms);
+    } else {
+        editorSetStatusMessage("%lld bytes written to disk", len);
+    }
+}
+
+// Write the snapshot to the new file and rename it over the file once it is
+// safely on disk, so a crash or a full disk never leaves half a file behind.
+// The old file lives on as long as it is mapped, so the rows can keep
+// pointing into it. Runs in the saving thread and only touches the job
+void editorSaveJobRun(saveJob *job) {
+    long long len = editorSnapshotWrite(job);
+    int saved_errno = errno;
+    if (len == -1 || fsync(job->fd) == -1) {
+        saved_errno = errno;
+        len = -1;
+    }
+    if (close(job->fd) == -1 && len != -1) {
+        saved_errno = errno;
+        len = -1;
+    }
+    if (len != -1 && rename(job->tmp, job->path) == -1) {
+        saved_errno = errno;
+        len = -1;
+    }
+    if (len == -1) {
+        unlink(job->tmp);
+    } else {
+        // the rename itself is on disk once the directory is
+        char *path = job->path;
+        char *slash = strrchr(path, '/');
+        if (slash) {
+            *slash = '\0';
+        }
+        int dir = open(slash ? (slash == path ? "/" : path) : ".", O_RDONLY);
+        if (dir != -1) {
+            fsync(dir);
+            close(dir);
+        }
+    }
+    job->result = len;
+    job->error = saved_errno;
+}
+
+void editorSaveJobFree(saveJob *job) {
+    free(job->path);
+    free(job->tmp);
+    free(job->pieces);
+    free(job->copy);
+    free(job);
+}
+
+#if KILO_HL_THREAD
+
+void *editorSaveThreadMain(void *arg) {
+    saveJob *job = arg;
+    editorSaveJobRun(job);
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+    editorWake();
+    return NULL;
+}
+
+// run `job` on a thread of its own. Returns 0 if none could be started
+int editorSaveThreadStart(saveJob *job) {
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGWINCH);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    E.buf->save_threaded = (pthread_create(&E.buf->save_thread, NULL,
+                                      editorSaveThreadMain, job) == 0);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return E.buf->save_threaded;
+}
+
+#else
+
+int editorSaveThreadStart(saveJob *job) {
+    (void)job;
+    return 0;
+}
+
+#endif
+
+// take over the result of the save once its thread is done, and do what was
+// asked for meanwhile
+void editorSaveFinish() {
+    saveJob *job = E.buf->save_job;
+#if KILO_HL_THREAD
+    if (E.buf->save_threaded) {
+        pthread_join(E.buf->save_thread, NULL);
+    }
+#endif
+    E.buf->save_job = NULL;
+    E.buf->save_threaded = 0;
+    E.buf->save_shown = -1;
+    editorSaveDone(job->result, job->error, job->start, job->dirty);
+    int saved = (job->result != -1);
+    editorSaveJobFree(job);
+
+    // quitting waits for the saves of all buffers
+    if (E.save_quit && !editorBuffersSaving()) {
+        E.save_quit = 0;
+        if (saved && !editorBuffersDirty()) {
+            editorQuit();
+        }
+        if (saved) {
+            editorSetStatusMessage("A file changed while it was saved, "
+                                   "not quitting");
+        }
+    }
+    if (E.buf->save_again) {
+        E.buf->save_again = 0;
+        if (E.buf->dirty) {
+            editorSaveStart();
+        }
+    }
+}
+
+// Save the file without making the editor wait for it: the rows are captured
+// (see editorSnapshotTake()) and a thread writes them to a new file next to
+// the file and renames it over the file once it is done. Meanwhile the rows
+// may be edited, the status bar shows how far the save got and the main
+// thread picks up the result in editorSaveIdle()
+void editorSaveStart() {
+    if (E.buf->save_job) {
+        E.buf->save_again = 1;
+        editorSetStatusMessage("Saving again once this save is done");
+        return;
+    }
+    // the file is about to be something else than what the rows were read
+    // from
+    E.buf->cache_wanted = 0;
+    // a symbolic link is followed, instead of being replaced by the file
+    char *path = realpath(E.buf->file_name, NULL);
+    if (path == NULL) {
+        path = strdup(E.buf->file_name);
+    }
+    struct stat st;
+    int exists = (stat(path, &st) == 0);
+    int fd = -1;
+    char *tmp = NULL;
+    if (!exists || S_ISREG(st.st_mode)) {
+        size_t path_len = strlen(path);
+        tmp = malloc(path_len + 16);
+        memcpy(tmp, path, path_len);
+        memcpy(&tmp[path_len], ".kilo-XXXXXX", 13);
+        fd = mkstemp(tmp);
+    }
+    if (fd == -1) {
+        // a special file, or a directory we can't create files in
+        long long start = editorNowMs();
+        long long len = editorSaveInPlace(path);
+        editorSaveDone(len, errno, start, E.buf->dirty);
+        free(tmp);
+        free(path);
+        return;
+    }
+    // the new file takes over what the old one had
+    if (exists) {
+        fchmod(fd, st.st_mode & 07777);
+        // only root can give the file to another user, the group may work
+        if (fchown(fd, st.st_uid, st.st_gid) == -1) {
+            fchown(fd, -1, st.st_gid);
+        }
+    } else {
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0644 & ~mask);
+    }
+
+    saveJob *job = calloc(1, sizeof(saveJob));
+    job->path = path;
+    job->tmp = tmp;
+    job->fd = fd;
+    job->dirty = E.buf->dirty;
+    job->start = editorNowMs();
+    editorSnapshotTake(job);
+    E.buf->save_job = job;
+    if (!editorSaveThreadStart(job)) {
+        editorSaveJobRun(job);
+        job->done = 1;
+        editorSaveFinish();
+    }
+}
+
+// stop the saves that are running, and wait for their threads. The files
+// stay what they were, unless a save was already past writing its file
+void editorSaveCancel() {
+    editorBuffer *buf = E.buf;
+    E.save_quit = 0;
+    for (int i = 0; i < E.num_bufs; i++) {
+        E.buf = E.bufs[i];
+        if (E.buf->save_job) {
+            __atomic_store_n(&E.buf->save_job->cancel, 1, __ATOMIC_RELAXED);
+            E.buf->save_again = 0;
+            editorSaveFinish();
+        }
+    }
+    E.buf = buf;
+}
+
+// how far the running save got, in percent
+int editorSaveProgress() {
+    saveJob *job = E.buf->save_job;
+    if (job->total == 0) {
+        return 100;
+    }
+    long long written = __atomic_load_n(&job->written, __ATOMIC_RELAXED);
+    return (int)(written * 100 / job->total);
+}
+
+// called while waiting for input, for the saves of all buffers. Returns
+// whether the status bars should be drawn again, because a save is done or
+// got further
+int editorSaveIdle() {
+    editorBuffer *buf = E.buf;
+    int redraw = 0;
+    for (int i = 0; i < E.num_bufs; i++) {
+        E.buf = E.bufs[i];
+        if (E.buf->save_job == NULL) {
+            continue;
+        }
+        if (__atomic_load_n(&E.buf->save_job->done, __ATOMIC_ACQUIRE)) {
+            editorSaveFinish();
+            redraw = 1;
+        } else if (editorSaveProgress() != E.buf->save_shown) {
+            redraw = 1;
+        }
+    }
+    E.buf = buf;
+    return redraw;
+}
+
+// milliseconds until the progress of the saves is looked at again, or -1 if
+// no save is running
+int editorSaveTimeout() {
+    return editorBuffersSaving() ? KILO_SAVE_TICK : -1;
+}
+
+void editorSave() {
+    if (E.buf->file_name == NULL) {
+        E.buf->file_name = editorPrompt("Save as: %s", NULL, 0);
+        if (E.buf->file_name == NULL) {
+            editorSetStatusMessage("Save aborted");
+            return;
+        }
+        editorSelectSyntaxHighlight();
+    }
+    editorSaveStart();
+}
+
+/*** line cache ***/
+
+// A large file keeps a cache of where its lines start and which of them end
+// inside a multi-line comment, written once every row has been highlighted
+// (editorCacheIdle()). Opened again, the file is split with it instead of
+// being searched for line breaks, and every row is ready to be highlighted
+// on its own, wherever the screen goes. A cache is only used for the very
+// file it was made of: same size, modification time and inode, the same
+// bytes in a few pages spread over it, and the same comment and string
+// delimiters
+
+// FNV-1a of `len` bytes at `p`, going on from `h`
+unsigned long long editorHash(unsigned long long h, const void *p,
+                              size_t len) {
+    const unsigned char *s = p;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ s[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+// the cache files go to the directory KILO_CACHE names, or to kilo/ in
+// $XDG_CACHE_HOME or in ~/.cache. An empty KILO_CACHE turns them off
+void editorCacheInit() {
+    char *dir = getenv("KILO_CACHE");
+    char *xdg = getenv("XDG_CACHE_HOME");
+    char *home = getenv("HOME");
+    char buf[PATH_MAX];
+    if (dir == NULL && xdg && xdg[0]) {
+        snprintf(buf, sizeof(buf), "%s/kilo", xdg);
+        dir = buf;
+    } else if (dir == NULL && home) {
+        snprintf(buf, sizeof(buf), "%s/.cache/kilo", home);
+        dir = buf;
+    }
+    E.cache_dir = dir && dir[0] ? strdup(dir) : NULL;
+}
+
+// the cache file for E.buf, named by a hash of the full path of its file,
+// which goes to `*path`. NULL if there is none
+char *editorCachePath(char **path) {
+    if (E.cache_dir == NULL ||
+        (*path = realpath(E.buf->file_name, NULL)) == NULL) {
+        return NULL;
+    }
+    unsigned long long h =
+        editorHash(14695981039346656037ull, *path, strlen(*path));
+    char *name = malloc(strlen(E.cache_dir) + 18);
+    sprintf(name, "%s/%016llx", E.cache_dir, h);
+    return name;
+}
+
+// describe the file mapped at `map` in E.buf->cache, as its cache has to
+void editorCacheKey(char *map, struct stat *st) {
+    cacheHeader *c = &E.buf->cache;
+    memset(c, 0, sizeof(cacheHeader));
+    memcpy(c->magic, "kilo\0\0\0\1", 8);
+    c->size = st->st_size;
+    c->dev = st->st_dev;
+    c->ino = st->st_ino;
+    c->mtime_sec = st->st_mtim.tv_sec;
+    c->mtime_nsec = st->st_mtim.tv_nsec;
+    // a file rewritten to the same size within the resolution of the time
+    // still shows in some of its pages, and hashing all of it would cost as
+    // much as finding the line breaks
+    size_t size = st->st_size;
+    size_t page = size < KILO_CACHE_PAGE ? size : KILO_CACHE_PAGE;
+    unsigned long long h = 14695981039346656037ull;
+    for (int i = 0; i < KILO_CACHE_SAMPLES; i++) {
+        h = editorHash(h, map + (size - page) * i / (KILO_CACHE_SAMPLES - 1),
+                       page);
+    }
+    c->content = h;
+    // the comments and the strings, in which comments don't start
+    h = 14695981039346656037ull;
+    struct editorSyntax *syntax = E.buf->syntax;
+    if (syntax) {
+        char *parts[] = {syntax->single_line_comment_start,
+                         syntax->multi_line_comment_start,
+                         syntax->multi_line_comment_end, syntax->quotes};
+        for (int j = 0; j < 4; j++) {
+            h = parts[j] ? editorHash(h, parts[j], strlen(parts[j]) + 1)
+                         : editorHash(h, "", 1);
+        }
+        h = editorHash(h, &syntax->flags, sizeof(syntax->flags));
+    }
+    c->syntax = h;
+}
+
+// Split the file mapped at `map` into rows with its cache, if it has one that
+// was made of the very same file, and take the rows' comment states from it,
+// so no row has to wait for the rows above it to be highlighted. Returns
+// whether it did. Call editorCacheKey() first
+int editorCacheLoad(char *map, size_t map_len) {
+    char *path = NULL;
+    char *name = editorCachePath(&path);
+    int fd = name ? open(name, O_RDONLY) : -1;
+    free(name);
+    cacheHeader *c = &E.buf->cache;
+    cacheHeader h;
+    struct stat st;
+    size_t path_len = path ? strlen(path) : 0;
+    size_t rows_at = sizeof(cacheHeader) + ((path_len + 7) & ~7);
+    int ok = fd != -1 && read(fd, &h, sizeof(h)) == sizeof(h) &&
+             fstat(fd, &st) == 0 && h.num_rows > 0 && h.num_rows < INT_MAX;
+    if (ok) {
+        c->path_len = path_len;
+        c->num_rows = h.num_rows;
+        ok = memcmp(&h, c, sizeof(cacheHeader)) == 0 &&
+             (size_t)st.st_size == rows_at + 8 * (h.num_rows + 1) +
+                                       (h.num_rows + 7) / 8;
+    }
+    // read rather than mapped: a cache file truncated while it is read
+    // just fails the checks, where a mapped one would raise SIGBUS
+    char *data = ok ? malloc(st.st_size) : NULL;
+    size_t got = 0;
+    while (data && got < (size_t)st.st_size) {
+        ssize_t r = pread(fd, data + got, st.st_size - got, got);
+        if (r <= 0 && !(r == -1 && errno == EINTR)) {
+            break;
+        }
+        got += r > 0 ? r : 0;
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    if (data == NULL || got < (size_t)st.st_size) {
+        free(data);
+        free(path);
+        return 0;
+    }
+    int n = h.num_rows;
+    const unsigned long long *offs =
+        (const unsigned long long *)(data + rows_at);
+    const unsigned char *bits = (const unsigned char *)&offs[n + 1];
+
+    // the lines follow each other up to the end of the file, so a damaged
+    // cache is noticed before any row is made of it
+    ok = !memcmp(data + sizeof(cacheHeader), path, path_len) &&
+         offs[0] == 0 && !(offs[n] & KILO_CACHE_CR) &&
+         (offs[n] == map_len || offs[n] == map_len + 1);
+    for (int i = 0; i < n && ok; i++) {
+        ok = (offs[i + 1] & ~KILO_CACHE_CR) >
+             (offs[i] & ~KILO_CACHE_CR) + (offs[i] >> 63);
+    }
+    if (ok) {
+        E.buf->map = map;
+        E.buf->map_len = map_len;
+        rowLeaf *leaf = NULL;
+        for (int i = 0; i < n; i++) {
+            size_t start = offs[i] & ~KILO_CACHE_CR;
+            size_t end = (offs[i + 1] & ~KILO_CACHE_CR) - 1 - (offs[i] >> 63);
+            editorLoadRow(&leaf, map + start, end - start,
+                          (bits[i / 8] >> (i % 8)) & 1);
+        }
+        if (leaf) {
+            editorRowsAppendLeaf(leaf);
+        }
+        E.buf->hl_ready = n;
+    }
+    free(data);
+    free(path);
+    return ok;
+}
+
+// Write the cache of E.buf, whose rows have to be the lines of the mapped
+// file still: the offset of each row in the file, with KILO_CACHE_CR set if
+// the line ended in "\r\n", where a line after the last one would start, and
+// the rows' `hl_open_comment`. It is written to a new file that is renamed
+// over the old one, so a cache is never seen half written
+void editorCacheSave() {
+    E.buf->cache_wanted = 0;
+    char *path = NULL;
+    char *name = editorCachePath(&path);
+    if (name == NULL) {
+        free(path);
+        return;
+    }
+    int n = E.buf->num_rows;
+    unsigned long long *offs = malloc(sizeof(unsigned long long) * (n + 1));
+    unsigned char *bits = calloc((n + 7) / 8, 1);
+    char *map = E.buf->map;
+    size_t next = 0;
+    int ok = 1;
+    rowIter it;
+    for (erow *row = editorRowIterStart(&it, 0); row && ok;
+         row = editorRowIterNext(&it)) {
+        ok = editorRowIsMapped(row) && row->chars == map + next;
+        size_t end = next + row->size;
+        int cr = end < E.buf->map_len && map[end] == '\r';
+        offs[row->index] = next | (cr ? KILO_CACHE_CR : 0);
+        bits[row->index / 8] |= row->hl_open_comment << (row->index % 8);
+        next = end + cr + 1;
+    }
+    offs[n] = next;
+    ok = ok && (next == E.buf->map_len || next == E.buf->map_len + 1);
+
+    // the directory and the ones it is in, as far as they are missing
+    for (char *slash = strchr(E.cache_dir + 1, '/'); ok && slash;
+         slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(E.cache_dir, 0700);
+        *slash = '/';
+    }
+    mkdir(E.cache_dir, 0700);
+    size_t name_len = strlen(name);
+    char *tmp = malloc(name_len + 8);
+    memcpy(tmp, name, name_len);
+    memcpy(&tmp[name_len], ".XXXXXX", 8);
+    int fd = ok ? mkstemp(tmp) : -1;
+    if (fd != -1) {
+        cacheHeader h = E.buf->cache;
+        h.path_len = strlen(path);
+        h.num_rows = n;
+        static const char pad[8];
+        fileWriter w;
+        editorWriterInit(&w, fd);
+        ok = editorWriterAppend(&w, (char *)&h, sizeof(h)) != -1 &&
+             editorWriterAppend(&w, path, h.path_len) != -1 &&
+             editorWriterAppend(&w, pad, (8 - h.path_len % 8) % 8) != -1 &&
+             editorWriterAppend(&w, (char *)offs, 8 * (n + 1)) != -1 &&
+             editorWriterAppend(&w, (char *)bits, (n + 7) / 8) != -1 &&
+             editorWriterFlush(&w) != -1;
+        close(fd);
+        if (!ok || rename(tmp, name) == -1) {
+            unlink(tmp);
+        }
+    }
+    free(tmp);
+    free(offs);
+    free(bits);
+    free(name);
+    free(path);
+}
+
+// whether the cache of E.buf can be written now: all of its rows are still
+// the lines of the file and know their comment states
+int editorCacheReady() {
+    return E.buf->cache_wanted && !E.buf->dirty && E.buf->map_fd != -1 &&
+           !E.buf->save_job &&
+           (E.buf->hl_ready >= E.buf->num_rows || !editorSyntaxHasState());
+}
+
+// called while waiting for input
+void editorCacheIdle() {
+    if (editorCacheReady()) {
+        editorCacheSave();
+    }
+}
+
+/*** buffers and windows ***/
+
+// a new buffer without a file, which no window shows yet
+editorBuffer *editorBufferNew() {
+    editorBuffer *b = calloc(1, sizeof(editorBuffer));
+    b->map_fd = -1;
+    b->save_shown = -1;
+    b->follow.fd = b->follow.wd = -1;
+    if (E.num_bufs == E.bufs_cap) {
+        E.bufs_cap = editorGrowCap(E.bufs_cap, E.num_bufs + 1);
+        E.bufs = realloc(E.bufs, sizeof(editorBuffer *) * E.bufs_cap);
+    }
+    E.bufs[E.num_bufs++] = b;
+    editorBuffer *buf = E.buf;
+    E.buf = b;
+    editorUndoInit();
+    E.buf = buf;
+    return b;
+}
+
+// whether any buffer is being saved
+int editorBuffersSaving() {
+    for (int i = 0; i < E.num_bufs; i++) {
+        if (E.bufs[i]->save_job) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// whether any buffer has unsaved changes
+int editorBuffersDirty() {
+    for (int i = 0; i < E.num_bufs; i++) {
+        if (E.bufs[i]->dirty) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// split the screen evenly among the windows from top to bottom, each one
+// with its status bar below it. Windows that would get no row at all are
+// closed, from the bottom up
+void editorLayoutWindows() {
+    int lines = E.screen_rows + 1; // all but the message bar
+    while (E.num_wins > 1 && lines / E.num_wins < 2) {
+        E.num_wins--;
+        if (E.win == &E.wins[E.num_wins]) {
+            E.win--;
+            E.buf = E.win->buf;
+        }
+    }
+    int top = 0;
+    for (int i = 0; i < E.num_wins; i++) {
+        int share = lines / E.num_wins + (i < lines % E.num_wins);
+        E.wins[i].top = top;
+        E.wins[i].screen_rows = share - 1;
+        top += share;
+    }
+}
+
+// E.win stops showing E.buf: the buffer remembers where the cursor was, and
+// the rows only this window showed drop their view
+void editorLeaveBuffer() {
+    editorWindow *w = E.win;
+    w->buf->cx = w->cx;
+    w->buf->cy = w->cy;
+    w->buf->row_off = w->row_off;
+    w->buf->col_off = w->col_off;
+    editorKeepRows(0, 0);
+}
+
+// show `b` in E.win, with the cursor where it was when `b` was last left
+void editorShowBuffer(editorBuffer *b) {
+    editorWindow *w = E.win;
+    if (b == w->buf) {
+        return;
+    }
+    editorLeaveBuffer();
+    w->buf = E.buf = b;
+    w->cx = b->cx;
+    w->cy = b->cy;
+    w->row_off = b->row_off;
+    w->col_off = b->col_off;
+    w->view_from = w->view_to = 0;
+    // the other windows may have changed it meanwhile
+    editorClampCursor();
+}
+
+// show the next open file in E.win
+void editorNextBuffer() {
+    int i = 0;
+    while (E.bufs[i] != E.buf) {
+        i++;
+    }
+    if (E.num_bufs == 1) {
+        editorSetStatusMessage("No other file is open, Ctrl-O opens one");
+        return;
+    }
+    editorShowBuffer(E.bufs[(i + 1) % E.num_bufs]);
+}
+
+// whether `a` and `b` name the same file
+int editorSameFile(const char *a, const char *b) {
+    struct stat sa, sb;
+    if (stat(a, &sa) == 0 && stat(b, &sb) == 0) {
+        return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+    }
+    return strcmp(a, b) == 0;
+}
+
+// ask for a file and show it in E.win. A file that is already open is shown
+// as it is, one that doesn't exist yet starts out empty
+void editorOpenPrompt() {
+    char *name = editorPrompt("Open: %s", NULL, 0);
+    if (name == NULL) {
+        editorSetStatusMessage("Open aborted");
+        return;
+    }
+    for (int i = 0; i < E.num_bufs; i++) {
+        if (E.bufs[i]->file_name &&
+            editorSameFile(E.bufs[i]->file_name, name)) {
+            editorShowBuffer(E.bufs[i]);
+            free(name);
+            return;
+        }
+    }
+    struct stat st;
+    int exists = (stat(name, &st) == 0);
+    int fd = exists ? open(name, O_RDONLY) : -1;
+    if ((exists && fd == -1) || (!exists && errno != ENOENT)) {
+        editorSetStatusMessage("Can't open %s: %s", name, strerror(errno));
+        free(name);
+        return;
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    if (exists && S_ISDIR(st.st_mode)) {
+        editorSetStatusMessage("Can't open %s: it is a directory", name);
+        free(name);
+        return;
+    }
+    editorShowBuffer(editorBufferNew());
+    if (exists) {
+        editorOpen(name);
+    } else {
+        E.buf->file_name = name;
+        name = NULL;
+        editorSelectSyntaxHighlight();
+        editorSetStatusMessage("New file");
+    }
+    free(name);
+}
+
+// split E.win in two that show the same rows of the same buffer, the keys
+// keep going to the upper one
+void editorSplitWindow() {
+    if (E.num_wins == KILO_WINDOWS_MAX ||
+        (E.screen_rows + 1) / (E.num_wins + 1) < 2) {
+        editorSetStatusMessage("No room for another window");
+        return;
+    }
+    int at = E.win - E.wins;
+    memmove(&E.wins[at + 2], &E.wins[at + 1],
+            sizeof(editorWindow) * (E.num_wins - at - 1));
+    E.wins[at + 1] = E.wins[at];
+    E.wins[at + 1].view_from = E.wins[at + 1].view_to = 0;
+    E.num_wins++;
+    editorLayoutWindows();
+}
+
+// close E.win, the window below it takes the keys (or the one above, if it
+// was the last one)
+void editorCloseWindow() {
+    editorLeaveBuffer();
+    int at = E.win - E.wins;
+    memmove(&E.wins[at], &E.wins[at + 1],
+            sizeof(editorWindow) * (E.num_wins - at - 1));
+    E.num_wins--;
+    if (at == E.num_wins) {
+        at--;
+    }
+    E.win = &E.wins[at];
+    E.buf = E.win->buf;
+    editorLayoutWindows();
+}
+
+// give the keys to the next window down, or the top one after the last
+void editorNextWindow() {
+    E.win = &E.wins[(E.win - E.wins + 1) % E.num_wins];
+    E.buf = E.win->buf;
+    // the rows may have changed while another window had the keys
+    editorClampCursor();
+}
+
+/*** follow ***/
+
+// have inotify tell when the file `path` changes, returns the watch or -1.
+// Without inotify the file is looked at every KILO_FOLLOW_POLL_MS instead
+int editorFollowWatch(const char *path) {
+#if defined(__linux__)
+    if (E.inotify_fd == -1) {
+        E.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (E.inotify_fd == -1) {
+            return -1;
+        }
+    }
+    // IN_ATTRIB: also when the file is removed while it is open
+    return inotify_add_watch(E.inotify_fd, path,
+                             IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF |
+                                 IN_DELETE_SELF);
+#else
+    (void)path;
+    return -1;
+#endif
+}
+
+void editorFollowUnwatch(int wd) {
+#if defined(__linux__)
+    if (wd != -1) {
+        inotify_rm_watch(E.inotify_fd, wd);
+    }
+#else
+    (void)wd;
+#endif
+}
+
+// open the file of E.buf for following it, fills in everything about the
+// file in `follow` but where it is read from. Returns -1 with errno set if
+// it can't be followed
+int editorFollowOpen() {
+    followState *F = &E.buf->follow;
+    // O_NONBLOCK: a FIFO under the name doesn't block the editor
+    int fd = open(E.buf->file_name, O_RDONLY | O_NONBLOCK);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        int saved_errno = fd == -1 ? errno : EINVAL;
+        if (fd != -1) {
+            close(fd);
+        }
+        errno = saved_errno;
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    F->fd = fd;
+    F->dev = st.st_dev;
+    F->ino = st.st_ino;
+    F->wd = editorFollowWatch(E.buf->file_name);
+    F->moved = 0;
+    F->more = 1;
+    return 0;
+}
+
+// Make E.buf follow its file: what is appended to the file from now on is
+// appended to the rows, starting with what was appended since the file was
+// read. The buffer is read-only until editorFollowStop()
+void editorFollowStart() {
+    followState *F = &E.buf->follow;
+    if (E.buf->file_name == NULL) {
+        editorSetStatusMessage("There is no file to follow");
+        return;
+    }
+    // the rows have to be the file as it is on the disk
+    if (E.buf->dirty || E.buf->save_job) {
+        editorSetStatusMessage("Save the file before following it");
+        return;
+    }
+    if (editorFollowOpen() == -1) {
+        editorSetStatusMessage("Can't follow %s: %s", E.buf->file_name,
+                               errno == EINVAL ? "not a regular file"
+                                               : strerror(errno));
+        return;
+    }
+    // the rows stay in the mapping, whoever writes the file may truncate it
+    // and then editorMapShrunk() makes them what is left of it
+    F->off = E.buf->file_size;
+    char last;
+    F->partial = F->off > 0 && pread(F->fd, &last, 1, F->off - 1) == 1 &&
+                 last != '\n';
+    // to the last row, which the new rows come after
+    E.win->cy = E.buf->num_rows > 0 ? E.buf->num_rows - 1 : 0;
+    E.win->cx = 0;
+    editorSetStatusMessage("Following %s, Ctrl-E stops",
+                           E.buf->file_name);
+}
+
+// E.buf stops following its file. The rows are taken to be the file as far
+// as it was read
+void editorFollowStop() {
+    followState *F = &E.buf->follow;
+    editorFollowUnwatch(F->wd);
+    close(F->fd);
+    E.buf->file_size = F->off;
+    F->fd = F->wd = -1;
+    editorSetStatusMessage("Stopped following %s", E.buf->file_name);
+}
+
+// whether E.buf can't be changed because it follows its file, the status bar
+// says so if it can't
+int editorReadOnly() {
+    if (E.buf->follow.fd == -1) {
+        return 0;
+    }
+    editorSetStatusMessage("Read-only while following, Ctrl-E stops");
+    return 1;
+}
+
+// append `len` bytes read from the followed file to the rows of E.buf, with
+// a line that the last read left open going on in the last row. The windows
+// with the cursor on the last row keep it there, the ones past the end stay
+// past it
+void editorFollowAppend(char *s, size_t len) {
+    followState *F = &E.buf->follow;
+    int num_rows = E.buf->num_rows;
+    // 1 for the last row, 2 for past the end
+    int tail[KILO_WINDOWS_MAX];
+    for (int i = 0; i < E.num_wins; i++) {
+        int cy = E.wins[i].cy;
+        tail[i] = E.wins[i].buf != E.buf ? 0
+                  : cy >= num_rows       ? 2
+                  : cy == num_rows - 1;
+    }
+    // appending is not a change of the file, nor something to undo
+    int dirty = E.buf->dirty;
+    E.buf->undo.paused++;
+    char *p = s, *end = s + len;
+    while (p < end) {
+        char *nl = memchr(p, '\n', end - p);
+        char *line_end = nl ? nl : end;
+        if (F->partial) {
+            editorRowAppendString(editorRowAt(E.buf->num_rows - 1), p,
+                                  line_end - p);
+        } else {
+            editorInsertRow(E.buf->num_rows, p, line_end - p);
+        }
+        F->partial = (nl == NULL);
+        // "\r\n" ends a line like editorLoadMapped() takes it, the '\r' may
+        // have come with the read before
+        erow *row = editorRowAt(E.buf->num_rows - 1);
+        if (nl && row->size > 0 && row->chars[row->size - 1] == '\r') {
+            editorRowDelString(row, row->size - 1, 1);
+        }
+        p = line_end + 1;
+    }
+    E.buf->undo.paused--;
+    E.buf->dirty = dirty;
+
+    // the inserted rows may already have moved some of the cursors (see
+    // editorShiftViews()), so they are put where they belong
+    if (E.buf->num_rows == num_rows) {
+        return;
+    }
+    for (int i = 0; i < E.num_wins; i++) {
+        if (tail[i]) {
+            E.wins[i].cy = E.buf->num_rows - (tail[i] == 2 ? 0 : 1);
+            E.wins[i].cx = 0;
+        }
+    }
+}
+
+// once the followed file of E.buf is read to its end: if its name refers to
+// another file by now, it was rotated, and the new file is followed from its
+// start on. Returns whether it was
+int editorFollowRotated() {
+    followState *F = &E.buf->follow;
+    struct stat st;
+    if (stat(E.buf->file_name, &st) == -1) {
+        // moved or removed, the new file may not be there yet
+        F->moved = 1;
+        return 0;
+    }
+    if (st.st_dev == F->dev && st.st_ino == F->ino) {
+        F->moved = 0;
+        return 0;
+    }
+    int fd = F->fd, wd = F->wd;
+    if (editorFollowOpen() == -1) {
+        F->moved = 1;
+        return 0;
+    }
+    editorFollowUnwatch(wd);
+    close(fd);
+    // the rows read so far stay, the new file starts on a row of its own
+    F->off = 0;
+    F->partial = 0;
+    editorSetStatusMessage("%s was rotated, following the new file",
+                           E.buf->file_name);
+    return 1;
+}
+
+// Read up to KILO_FOLLOW_BATCH bytes that were appended to the followed file
+// of E.buf and append them to the rows. A file that is shorter than what was
+// read of it was truncated: if that cut into the mapping, the rows are what
+// is left of the file (editorMapShrunk()), otherwise the file is read again
+// from its start after the rows. Returns whether anything changed
+int editorFollowRead() {
+    followState *F = &E.buf->follow;
+    struct stat st;
+    if (fstat(F->fd, &st) == -1) {
+        return 0;
+    }
+    int changed = 0;
+    if (E.buf->map_fd != -1 && (size_t)st.st_size < E.buf->map_len) {
+        editorMapShrunk(st.st_size);
+        return 1;
+    }
+    if (st.st_size < F->off) {
+        F->off = 0;
+        F->partial = 0;
+        editorSetStatusMessage("%s was truncated", E.buf->file_name);
+        changed = 1;
+    }
+    if (st.st_size == F->off) {
+        F->more = 0;
+        return editorFollowRotated() || changed;
+    }
+    size_t len = st.st_size - F->off;
+    if (len > KILO_FOLLOW_BATCH) {
+        len = KILO_FOLLOW_BATCH;
+    }
+    char *buf = malloc(len);
+    ssize_t n = pread(F->fd, buf, len, F->off);
+    if (n > 0) {
+        F->off += n;
+        editorFollowAppend(buf, n);
+        changed = 1;
+    }
+    F->more = n > 0 && F->off < st.st_size;
+    free(buf);
+    return changed;
+}
+
+// read what the followed files got since the last time. The rows they get
+// are drawn at most once per KILO_FOLLOW_FRAME_MS, however fast they grow.
+// Returns whether to redraw
+int editorFollowIdle() {
+    editorBuffer *buf = E.buf;
+    for (int i = 0; i < E.num_bufs; i++) {
+        E.buf = E.bufs[i];
+        // no rows may come while the search prompt is open, see
+        // `searchIndex`
+        if (E.buf->follow.fd != -1 && !E.buf->search.active &&
+            editorFollowRead()) {
+            E.follow_pending = 1;
+        }
+    }
+    E.buf = buf;
+    long long now = editorNowMs();
+    if (E.follow_pending && now - E.follow_frame_at >= KILO_FOLLOW_FRAME_MS) {
+        E.follow_pending = 0;
+        E.follow_frame_at = now;
+        return 1;
+    }
+    return 0;
+}
+
+// milliseconds until the followed files need a look, or -1 if inotify will
+// tell
+int editorFollowTimeout() {
+    int timeout = -1;
+    for (int i = 0; i < E.num_bufs; i++) {
+        followState *F = &E.bufs[i]->follow;
+        if (F->fd == -1) {
+            continue;
+        }
+        int t = -1;
+        if (F->more && !E.bufs[i]->search.active) {
+            t = 0;
+        } else if (F->wd == -1 || F->moved) {
+            t = KILO_FOLLOW_POLL_MS;
+        }
+        if (t >= 0 && (timeout < 0 || t < timeout)) {
+            timeout = t;
+        }
+    }
+    if (E.follow_pending) {
+        long long left = E.follow_frame_at + KILO_FOLLOW_FRAME_MS -
+                         editorNowMs();
+        int t = left > 0 ? (int)left : 0;
+        if (timeout < 0 || t < timeout) {
+            timeout = t;
+        }
+    }
+    return timeout;
+}
+
+/*** regex ***/
+
+// Regular expressions for the search prompts: POSIX extended syntax and
+// leftmost-longest matches like regexec(), found in time linear in the length
+// of the row. The pattern is compiled into a Thompson NFA once per query. A
+// DFA built lazily from it, one state per set of NFA nodes the search can be
+// in, reads each byte once and tells whether and where the first match ends,
+// which turns away most rows. Only a row with a match is looked at again by
+// a Pike VM, which follows every thread of the NFA at once to find where
+// exactly the match starts and ends. Nothing backtracks, so no pattern can
+// blow up on a long row
+
+int regexClassHas(const unsigned char *cls, unsigned char c) {
+    return (cls[c >> 3] >> (c & 7)) & 1;
+}
+
+void regexClassSet(unsigned char *cls, unsigned char c) {
+    cls[c >> 3] |= 1 << (c & 7);
+}
+
+// a new byte set, empty
+int regexClassNew(regexParser *P) {
+    if (P->class_len == P->class_cap) {
+        P->class_cap = editorGrowCap(P->class_cap, P->class_len + 1);
+        P->classes = realloc(P->classes, sizeof(*P->classes) * P->class_cap);
+    }
+    memset(P->classes[P->class_len], 0, sizeof(*P->classes));
+    return P->class_len++;
+}
+
+// the bytes for which `is` holds, like isdigit()
+int regexClassOf(regexParser *P, int (*is)(int), int negate) {
+    int k = regexClassNew(P);
+    for (int c = 0; c < 256; c++) {
+        if ((is(c) != 0) != negate) {
+            regexClassSet(P->classes[k], c);
+        }
+    }
+    return k;
+}
+
+int regexIsWord(int c) { return isalnum(c) || c == '_'; }
+
+// the [:name:] classes of a bracket expression
+int (*regexNamedClass(const char *name, int len))(int) {
+    static const struct {
+        const char *name;
+        int (*is)(int);
+    } names[] = {{"alpha", isalpha}, {"digit", isdigit}, {"alnum", isalnum},
+                 {"upper", isupper}, {"lower", islower}, {"space", isspace},
+                 {"blank", isblank}, {"punct", ispunct}, {"print", isprint},
+                 {"graph", isgraph}, {"cntrl", iscntrl}, {"xdigit", isxdigit}};
+    for (unsigned k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+        if ((int)strlen(names[k].name) == len &&
+            strncmp(names[k].name, name, len) == 0) {
+            return names[k].is;
+        }
+    }
+    return NULL;
+}
+
+int regexAstNew(regexParser *P, int type, int a, int b) {
+    if (P->len == P->cap) {
+        P->cap = editorGrowCap(P->cap, P->len + 1);
+        P->ast = realloc(P->ast, sizeof(regexAst) * P->cap);
+    }
+    P->ast[P->len] = (regexAst){type, a, b, 0, 0};
+    return P->len++;
+}
+
+int regexParseAlt(regexParser *P);
+
+// a bracket expression, after its '['
+int regexParseBracket(regexParser *P) {
+    int k = regexClassNew(P);
+    int negate = (*P->p == '^');
+    if (negate) {
+        P->p++;
+    }
+    // a ']' right at the start is one of the bytes
+    int first = 1;
+    while (*P->p && (*P->p != ']' || first)) {
+        first = 0;
+        if (P->p[0] == '[' && P->p[1] == ':') {
+            const char *name = P->p + 2;
+            const char *end = strstr(name, ":]");
+            int (*is)(int) = end ? regexNamedClass(name, end - name) : NULL;
+            if (is == NULL) {
+                P->error = 1;
+                return 0;
+            }
+            for (int c = 0; c < 256; c++) {
+                if (is(c)) {
+                    regexClassSet(P->classes[k], c);
+                }
+            }
+            P->p = end + 2;
+            continue;
+        }
+        unsigned char lo = *P->p++, hi = lo;
+        if (P->p[0] == '-' && P->p[1] && P->p[1] != ']') {
+            hi = P->p[1];
+            P->p += 2;
+            if (hi < lo) {
+                P->error = 1;
+                return 0;
+            }
+        }
+        for (int c = lo; c <= hi; c++) {
+            regexClassSet(P->classes[k], c);
+        }
+    }
+    if (*P->p != ']') {
+        P->error = 1;
+        return 0;
+    }
+    P->p++;
+    if (negate) {
+        for (int i = 0; i < 32; i++) {
+            P->classes[k][i] = ~P->classes[k][i];
+        }
+    }
+    return regexAstNew(P, RA_CLASS, k, 0);
 }
 
-// append a string s with length len to a erow row
-void editorRowAppendString(erow *row, char *s, size_t len) {
-    row->chars = realloc(row->chars, row->size + len + 1);
-    memcpy(&row->chars[row->size], s, len);
-    row->size += len;
-    row->chars[row->size] = '\0';
-    editorUpdateRow(row);
-    E.dirty++;
+int regexParseAtom(regexParser *P) {
+    char c = *P->p++;
+    int k;
+    switch (c) {
+    case '(': {
+        int inner = regexParseAlt(P);
+        if (*P->p != ')') {
+            P->error = 1;
+            return 0;
+        }
+        P->p++;
+        return inner;
+    }
+    case '[':
+        return regexParseBracket(P);
+    case '.':
+        k = regexClassNew(P);
+        memset(P->classes[k], 0xff, sizeof(*P->classes));
+        return regexAstNew(P, RA_CLASS, k, 0);
+    case '^':
+        return regexAstNew(P, RA_BOL, 0, 0);
+    case '$':
+        return regexAstNew(P, RA_EOL, 0, 0);
+    case '*':
+    case '+':
+    case '?':
+        // nothing to repeat
+        P->error = 1;
+        return 0;
+    case '\\':
+        c = *P->p++;
+        switch (c) {
+        case '\0':
+            P->error = 1;
+            return 0;
+        case 'd':
+        case 'D':
+            return regexAstNew(P, RA_CLASS, regexClassOf(P, isdigit, c == 'D'),
+                               0);
+        case 'w':
+        case 'W':
+            return regexAstNew(P, RA_CLASS,
+                               regexClassOf(P, regexIsWord, c == 'W'), 0);
+        case 's':
+        case 'S':
+            return regexAstNew(P, RA_CLASS, regexClassOf(P, isspace, c == 'S'),
+                               0);
+        case 't':
+            c = '\t';
+            break;
+        }
+        break;
+    }
+    k = regexClassNew(P);
+    regexClassSet(P->classes[k], c);
+    return regexAstNew(P, RA_CLASS, k, 0);
 }
 
-void editorRowDelChar(erow *row, int at) {
-    if (at < 0 || at >= row->size) {
-        return;
+// a bound like {2}, {2,} or {2,5} at P->p. Returns 0 and leaves P->p alone if
+// there is none, then the '{' is just a character
+int regexParseBound(regexParser *P, int *min, int *max) {
+    const char *p = P->p + 1;
+    if (!isdigit((unsigned char)*p)) {
+        return 0;
+    }
+    *min = strtol(p, (char **)&p, 10);
+    *max = *min;
+    if (*p == ',') {
+        p++;
+        *max = isdigit((unsigned char)*p) ? strtol(p, (char **)&p, 10) : -1;
+    }
+    if (*p != '}') {
+        return 0;
+    }
+    if (*min > KILO_RE_DUP_MAX || *max > KILO_RE_DUP_MAX ||
+        (*max >= 0 && *max < *min)) {
+        P->error = 1;
     }
+    P->p = p + 1;
+    return 1;
+}
 
-    memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
-    row->size--;
-    editorUpdateRow(row);
-    E.dirty++;
+// an atom and the '*', '+', '?' and bounds after it
+int regexParseRepeat(regexParser *P) {
+    int atom = regexParseAtom(P);
+    while (!P->error) {
+        int min, max;
+        char c = *P->p;
+        if (c == '*' || c == '+' || c == '?') {
+            min = (c == '+');
+            max = (c == '?') ? 1 : -1;
+            P->p++;
+        } else if (c != '{' || !regexParseBound(P, &min, &max)) {
+            break;
+        }
+        atom = regexAstNew(P, RA_REPEAT, atom, 0);
+        P->ast[atom].min = min;
+        P->ast[atom].max = max;
+    }
+    return atom;
 }
 
-/*** editor operations ***/
+int regexParseCat(regexParser *P) {
+    int left = -1;
+    while (*P->p && *P->p != '|' && *P->p != ')' && !P->error) {
+        int atom = regexParseRepeat(P);
+        left = left < 0 ? atom : regexAstNew(P, RA_CAT, left, atom);
+    }
+    return left < 0 ? regexAstNew(P, RA_EMPTY, 0, 0) : left;
+}
 
-void editorInsertChar(int c) {
-    // if the cursor is on the tilde line after the end of the file
-    if (E.cy == E.num_rows) {
-        editorInsertRow(E.num_rows, "", 0);
+int regexParseAlt(regexParser *P) {
+    int left = regexParseCat(P);
+    while (*P->p == '|' && !P->error) {
+        P->p++;
+        left = regexAstNew(P, RA_ALT, left, regexParseCat(P));
     }
-    editorRowInsertChar(&E.rows[E.cy], E.cx, c);
-    E.cx++;
+    return left;
 }
 
-void editorInsertNewline() {
-    // insert a new blank row before the line we are on
-    if (E.cx == 0) {
-        editorInsertRow(E.cy, "", 0);
-    } else {
-        // insert a new line and truncate current line
-        erow *row = &E.rows[E.cy];
-        editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
-        row = &E.rows[E.cy];
-        row->size = E.cx;
-        row->chars = realloc(row->chars, row->size + 1);
-        row->chars[row->size] = '\0';
-        editorUpdateRow(row);
+int regexNodeNew(regexParser *P, regex *re, int op, int out, int out1,
+                 int cls) {
+    if (re->len == KILO_RE_NODES) {
+        P->error = 1;
+        return 0;
     }
-    // reposition the cursor
-    E.cy++;
-    E.cx = 0;
+    if (re->len == re->cap) {
+        re->cap = editorGrowCap(re->cap, re->len + 1);
+        re->nodes = realloc(re->nodes, sizeof(regexNode) * re->cap);
+    }
+    re->nodes[re->len] = (regexNode){op, out, out1, cls};
+    return re->len++;
 }
 
-void editorDelChar() {
-    if (E.cy == E.num_rows)
-        return;
-    if (E.cx == 0 && E.cy == 0)
-        return;
+// compile the syntax tree `ast` into nodes that go on to node `next`, and
+// return the first of them. Built back to front, so every node knows where
+// it leads when it is made
+int regexEmit(regexParser *P, regex *re, int ast, int next) {
+    if (P->error) {
+        return 0;
+    }
+    regexAst a = P->ast[ast];
+    switch (a.type) {
+    case RA_CLASS:
+        return regexNodeNew(P, re, RE_CLASS, next, -1, a.a);
+    case RA_BOL:
+        return regexNodeNew(P, re, RE_BOL, next, -1, 0);
+    case RA_EOL:
+        return regexNodeNew(P, re, RE_EOL, next, -1, 0);
+    case RA_CAT:
+        return regexEmit(P, re, a.a, regexEmit(P, re, a.b, next));
+    case RA_ALT: {
+        int left = regexEmit(P, re, a.a, next);
+        int right = regexEmit(P, re, a.b, next);
+        return regexNodeNew(P, re, RE_SPLIT, left, right, 0);
+    }
+    case RA_REPEAT: {
+        int at = next, copies = a.min;
+        if (a.max < 0) {
+            // a loop back through a split, entered through the body when it
+            // has to match at least once
+            int loop = regexNodeNew(P, re, RE_SPLIT, -1, next, 0);
+            int body = regexEmit(P, re, a.a, loop);
+            re->nodes[loop].out = body;
+            at = loop;
+            if (copies > 0) {
+                at = body;
+                copies--;
+            }
+        } else {
+            // x{2,4} is xx(x(x)?)?
+            for (int k = 0; k < a.max - a.min; k++) {
+                at = regexNodeNew(P, re, RE_SPLIT, regexEmit(P, re, a.a, at),
+                                  next, 0);
+            }
+        }
+        for (int k = 0; k < copies; k++) {
+            at = regexEmit(P, re, a.a, at);
+        }
+        return at;
+    }
+    }
+    return next; // RA_EMPTY
+}
 
-    erow *row = &E.rows[E.cy];
-    if (E.cx > 0) {
-        editorRowDelChar(row, E.cx - 1);
-        E.cx--;
+void regexFree(regex *re) {
+    for (int k = 0; k < re->run_count; k++) {
+        regexRun *r = &re->runs[k];
+        free(r->states);
+        free(r->set_nodes);
+        free(r->table);
+        free(r->mark);
+        free(r->stack);
+        free(r->set);
+        free(r->list[0]);
+        free(r->list[1]);
     }
-    // if E.cx == 0,
-    // append current row to previous row, and then delete current row
-    else {
-        E.cx = E.rows[E.cy - 1].size;
-        editorRowAppendString(&E.rows[E.cy - 1], row->chars, row->size);
-        editorDelRow(E.cy);
-        E.cy--;
+    free(re->runs);
+    free(re->nodes);
+    free(re->classes);
+    *re = (regex){0};
+}
+
+// empty the DFA of a run, which is built again as it is needed
+void regexDfaFlush(regexRun *r) {
+    r->len = 0;
+    r->set_len = 0;
+    for (int i = 0; i < KILO_RE_TABLE; i++) {
+        r->table[i] = -1;
     }
+    r->start[0] = r->start[1] = -1;
 }
 
-/*** file I/O ***/
+// compile `pattern` with room for `runs` threads to match it at the same
+// time. Returns 0 if it is not valid
+int regexCompile(regex *re, const char *pattern, int runs) {
+    *re = (regex){0};
+    regexParser P = {pattern, NULL, 0, 0, NULL, 0, 0, 0};
+    int root = regexParseAlt(&P);
+    if (*P.p != '\0') {
+        P.error = 1; // a ')' without a '('
+    }
+    int match = regexNodeNew(&P, re, RE_MATCH, -1, -1, 0);
+    re->start = regexEmit(&P, re, root, match);
+    re->classes = P.classes;
+    free(P.ast);
+    if (P.error) {
+        regexFree(re);
+        return 0;
+    }
 
-char *editorRowsToString(int *buf_len) {
-    int tot_len = 0;
+    re->runs = calloc(runs, sizeof(regexRun));
+    re->run_count = runs;
+    for (int k = 0; k < runs; k++) {
+        regexRun *r = &re->runs[k];
+        r->table = malloc(sizeof(int) * KILO_RE_TABLE);
+        r->set_cap = re->len;
+        r->set_nodes = malloc(sizeof(int) * r->set_cap);
+        r->mark = calloc(re->len, sizeof(unsigned int));
+        r->stack = malloc(sizeof(int) * re->len);
+        r->set = malloc(sizeof(int) * re->len);
+        r->list[0] = malloc(sizeof(int) * 2 * re->len);
+        r->list[1] = malloc(sizeof(int) * 2 * re->len);
+        regexDfaFlush(r);
+    }
+    return 1;
+}
 
-    // add up the lengths of each row of text, adding 1 to each one for the
-    // newline character we'll add to the end of each line
-    for (int i = 0; i < E.num_rows; i++) {
-        tot_len += E.rows[i].size + 1; // add one for '\n'
+// start a new round of marks, see regexClosure()
+void regexNewMarks(regex *re, regexRun *r) {
+    if (++r->gen == 0) {
+        memset(r->mark, 0, sizeof(unsigned int) * re->len);
+        r->gen = 1;
     }
-    *buf_len = tot_len;
+}
 
-    char *buf = malloc(tot_len);
-    char *p = buf;
-    for (int i = 0; i < E.num_rows; ++i) {
-        memcpy(p, E.rows[i].chars, E.rows[i].size);
-        p += E.rows[i].size;
-        *p = '\n';
-        p++;
+// add node `n` and the nodes it leads to without reading a byte to `r->set`,
+// unless they were added since the last regexNewMarks(). `bol` and `eol`
+// tell whether '^' and '$' hold here. The set keeps the nodes that read a
+// byte, RE_MATCH and the '$' nodes that wait for the end of the text
+void regexClosure(regex *re, regexRun *r, int n, int *len, int bol, int eol) {
+    int sp = 0;
+    if (r->mark[n] != r->gen) {
+        r->mark[n] = r->gen;
+        r->stack[sp++] = n;
+    }
+    while (sp > 0) {
+        int k = r->stack[--sp];
+        regexNode *node = &re->nodes[k];
+        int follow[2] = {-1, -1};
+        switch (node->op) {
+        case RE_SPLIT:
+            follow[0] = node->out1;
+            follow[1] = node->out;
+            break;
+        case RE_BOL:
+            follow[0] = bol ? node->out : -1;
+            break;
+        case RE_EOL:
+            if (eol) {
+                follow[0] = node->out;
+            } else {
+                r->set[(*len)++] = k;
+            }
+            break;
+        default:
+            r->set[(*len)++] = k;
+            break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (follow[i] >= 0 && r->mark[follow[i]] != r->gen) {
+                r->mark[follow[i]] = r->gen;
+                r->stack[sp++] = follow[i];
+            }
+        }
     }
+}
 
-    return buf; // expecting the caller to free() the memory
+int regexCompareInt(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
 }
 
-// it will open and read a file from the disk
-void editorOpen(char *file_name) {
-    free(E.file_name); // We may open more than one file at the same time
-    E.file_name = strdup(file_name); // strdup: save a copy of a string
+// the DFA state for the `len` nodes in `r->set`, made if it is new. Returns
+// -1 if the run has no room for another state
+int regexDfaState(regex *re, regexRun *r, int len) {
+    qsort(r->set, len, sizeof(int), regexCompareInt);
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ r->set[i]) * 16777619u;
+    }
+    int slot = hash & (KILO_RE_TABLE - 1);
+    while (r->table[slot] >= 0) {
+        regexState *s = &r->states[r->table[slot]];
+        if (s->hash == hash && s->len == len &&
+            memcmp(&r->set_nodes[s->first], r->set, sizeof(int) * len) == 0) {
+            return r->table[slot];
+        }
+        slot = (slot + 1) & (KILO_RE_TABLE - 1);
+    }
+    if (r->len == KILO_RE_STATES) {
+        return -1;
+    }
 
-    editorSelectSyntaxHighlight();
+    if (r->set_len + len > r->set_cap) {
+        r->set_cap = editorGrowCap(r->set_cap, r->set_len + len);
+        r->set_nodes = realloc(r->set_nodes, sizeof(int) * r->set_cap);
+    }
+    if (r->len == r->cap) {
+        r->cap = editorGrowCap(r->cap, r->len + 1);
+        r->states = realloc(r->states, sizeof(regexState) * r->cap);
+    }
+    regexState *s = &r->states[r->len];
+    s->first = r->set_len;
+    s->len = len;
+    s->hash = hash;
+    s->match = 0;
+    for (int i = 0; i < len; i++) {
+        if (re->nodes[r->set[i]].op == RE_MATCH) {
+            s->match = 1;
+        }
+    }
+    s->end_match = -1;
+    memset(s->next, -1, sizeof(s->next));
+    memcpy(&r->set_nodes[r->set_len], r->set, sizeof(int) * len);
+    r->set_len += len;
+    r->table[slot] = r->len;
+    return r->len++;
+}
 
-    // mode: "r": Open for reading, "w": Open for writing, "a": Open for
-    // appending
-    FILE *fp = fopen(file_name, "r");
-    if (!fp)
-        die("fopen");
-
-    char *line = NULL;
-    size_t line_cap = 0;
-    ssize_t line_len;
-    // We pass getline a null line pointer and a linecap of 0. That makes it
-    // allocate new memory for the next line it reads, and set line to point to
-    // the memory, and set linecap to let you know how much memory it allocated.
-    // It return value is the length of the line it reads, or -1 if it's at the
-    // end of the file and there are no more lines to read
-    while ((line_len = getline(&line, &line_cap, fp)) != -1) {
-        // truncate '\r\n' or '\n' at the end
-        while (line_len > 0 &&
-               (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) {
-            line_len--;
+// the state a search starts in, at the start of the text (`bol`) or inside it
+int regexDfaStart(regex *re, regexRun *r, int bol) {
+    if (r->start[bol] < 0) {
+        int len = 0;
+        regexNewMarks(re, r);
+        regexClosure(re, r, re->start, &len, bol, 0);
+        int st = regexDfaState(re, r, len);
+        if (st < 0) {
+            regexDfaFlush(r);
+            st = regexDfaState(re, r, len);
         }
-        editorInsertRow(E.num_rows, line, line_len);
+        r->start[bol] = st;
     }
-    free(line);
-    fclose(fp);
-    E.dirty = 0;
+    return r->start[bol];
 }
 
-// More advanced text editors will write to a new, temporary file, and then
-// rename that file to the actual file the user wants to overwrite
-void editorSave() {
-    if (E.file_name == NULL) {
-        E.file_name = editorPrompt("Save as: %s", NULL);
-        if (E.file_name == NULL) {
-            editorSetStatusMessage("Save aborted");
-            return;
+// the state after state `st` reads byte `c`. A match can start at any byte,
+// so the start of the NFA is always part of it. When the run is out of room,
+// all the states are dropped first
+int regexDfaStep(regex *re, regexRun *r, int st, unsigned char c) {
+    int len = 0;
+    regexNewMarks(re, r);
+    int first = r->states[st].first, count = r->states[st].len;
+    for (int i = 0; i < count; i++) {
+        regexNode *node = &re->nodes[r->set_nodes[first + i]];
+        if (node->op == RE_CLASS && regexClassHas(re->classes[node->cls], c)) {
+            regexClosure(re, r, node->out, &len, 0, 0);
         }
-        editorSelectSyntaxHighlight();
     }
+    regexClosure(re, r, re->start, &len, 0, 0);
+    int next = regexDfaState(re, r, len);
+    if (next < 0) {
+        regexDfaFlush(r);
+        return regexDfaState(re, r, len);
+    }
+    r->states[st].next[c] = next;
+    return next;
+}
 
-    int len;
-    char *buf = editorRowsToString(&len);
+// whether a match ends if the text ends in state `st`, for the '$' in it
+int regexDfaEndMatch(regex *re, regexRun *r, int st) {
+    regexState *s = &r->states[st];
+    if (s->end_match < 0) {
+        int len = 0;
+        regexNewMarks(re, r);
+        for (int i = 0; i < s->len; i++) {
+            regexNode *node = &re->nodes[r->set_nodes[s->first + i]];
+            if (node->op == RE_EOL) {
+                regexClosure(re, r, node->out, &len, 0, 1);
+            }
+        }
+        s->end_match = s->match;
+        for (int i = 0; i < len; i++) {
+            if (re->nodes[r->set[i]].op == RE_MATCH) {
+                s->end_match = 1;
+            }
+        }
+    }
+    return s->end_match;
+}
 
-    // open for reading and writing. create if not exists
-    int fd = open(E.file_name, O_RDWR | O_CREAT, 0644);
-    if (fd != -1) {
-        // Sets the file's size to the specified length. If the file is larger
-        //  than that, it will cut off any data at the end of the file to make
-        //  it that length. If the file is shorter, it will add `0` bytes at
-        //  the end to make it that length.
-        if (ftruncate(fd, len) != -1) {
-            if (write(fd, buf, len) == len) {
-                close(fd);
-                free(buf);
-                E.dirty = 0;
-                editorSetStatusMessage("%d bytes written to disk", len);
-                return;
+// where the first match to end at or after `from` in `s` (of length `n`)
+// ends, or -1 if there is none
+int regexDfaScan(regex *re, regexRun *r, const char *s, int n, int from) {
+    int st = regexDfaStart(re, r, from == 0);
+    if (r->states[st].match) {
+        return from;
+    }
+    for (int i = from; i < n; i++) {
+        int next = r->states[st].next[(unsigned char)s[i]];
+        st = next >= 0 ? next : regexDfaStep(re, r, st, s[i]);
+        if (r->states[st].match) {
+            return i + 1;
+        }
+    }
+    return regexDfaEndMatch(re, r, st) ? n : -1;
+}
+
+// the Pike VM: add a thread that is at node `n` at position `at` and started
+// at `start` to the threads in `list`, following the nodes that don't read a
+// byte. Each node is only taken by the first thread to get there, the one
+// that started earliest. A thread that gets to RE_MATCH is a match, kept in
+// `best` if it starts before the best one so far or ends after it
+void regexVmAdd(regex *re, regexRun *r, int *list, int *len, int n, int start,
+                int at, int text_len, int *best) {
+    int set_len = 0;
+    regexClosure(re, r, n, &set_len, at == 0, at == text_len);
+    for (int i = 0; i < set_len; i++) {
+        int k = r->set[i];
+        if (re->nodes[k].op == RE_CLASS) {
+            list[2 * *len] = k;
+            list[2 * *len + 1] = start;
+            (*len)++;
+        } else if (re->nodes[k].op == RE_MATCH &&
+                   (best[0] < 0 || start < best[0] ||
+                    (start == best[0] && at > best[1]))) {
+            best[0] = start;
+            best[1] = at;
+        }
+    }
+}
+
+// the leftmost-longest match at or after `from`, see regexFind()
+int regexVmRun(regex *re, regexRun *r, const char *s, int n, int from,
+               int *len) {
+    int best[2] = {-1, -1};
+    int *cur = r->list[0], *next = r->list[1];
+    int cur_len = 0;
+    regexNewMarks(re, r);
+    for (int i = from;; i++) {
+        // the threads are kept in the order they started, and once there is
+        // a match no thread that starts later is of any use
+        if (best[0] < 0) {
+            regexVmAdd(re, r, cur, &cur_len, re->start, i, i, n, best);
+        }
+        if (i == n || (cur_len == 0 && best[0] >= 0)) {
+            break;
+        }
+        regexNewMarks(re, r);
+        int next_len = 0;
+        for (int t = 0; t < cur_len; t++) {
+            regexNode *node = &re->nodes[cur[2 * t]];
+            int start = cur[2 * t + 1];
+            if ((best[0] < 0 || start <= best[0]) &&
+                regexClassHas(re->classes[node->cls], s[i])) {
+                regexVmAdd(re, r, next, &next_len, node->out, start, i + 1, n,
+                           best);
             }
         }
-        close(fd);
+        int *swap = cur;
+        cur = next;
+        next = swap;
+        cur_len = next_len;
+    }
+    if (best[0] < 0) {
+        return -1;
     }
+    *len = best[1] - best[0];
+    return best[0];
+}
 
-    free(buf);
-    editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+// where the leftmost-longest match at or after `from` in `s` (of length `n`)
+// starts, or -1, with its length in `*len`. `run` picks the thread's state
+int regexFind(regex *re, int run, const char *s, int n, int from, int *len) {
+    regexRun *r = &re->runs[run];
+    if (regexDfaScan(re, r, s, n, from) < 0) {
+        return -1;
+    }
+    return regexVmRun(re, r, s, n, from, len);
 }
 
 /*** find ***/
 
-void editorFindCallback(char *query, int key) {
-    static int last_match = -1;
-    // 1 means next line, -1 means previous line
-    static int direction = 1;
+// index of the first `q` (of length `m`, at least 1) in `s`, or -1. The
+// vector loops look for blocks where both the first and the last byte of `q`
+// are in the right places, which is rare enough that only those candidates
+// are compared in full; the plain loop after them finishes with memchr()
+int editorSearchMem(const char *s, int n, const char *q, int m) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(q[0]), last = _mm_set1_epi8(q[m - 1]);
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i + m - 1));
+        int mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            int j = i + __builtin_ctz(mask);
+            if (memcmp(s + j + 1, q + 1, m - 1) == 0) {
+                return j;
+            }
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    const uint8x16_t first = vdupq_n_u8(q[0]), last = vdupq_n_u8(q[m - 1]);
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        uint8x16_t a = vld1q_u8((const uint8_t *)s + i);
+        uint8x16_t b = vld1q_u8((const uint8_t *)s + i + m - 1);
+        if (vmaxvq_u8(vandq_u8(vceqq_u8(a, first), vceqq_u8(b, last)))) {
+            break;
+        }
+    }
+#endif
+    while (i + m <= n) {
+        const char *p = memchr(s + i, q[0], n - m + 1 - i);
+        if (p == NULL) {
+            return -1;
+        }
+        i = p - s;
+        if (memcmp(p + 1, q + 1, m - 1) == 0) {
+            return i;
+        }
+        i++;
+    }
+    return -1;
+}
+
+void editorPatternFree(searchPattern *p) {
+    regexFree(&p->re);
+    free(p->text);
+    *p = (searchPattern){0};
+}
+
+// compile `query`, see `searchPattern`. Returns 0 if it is not a valid
+// regex, the pattern then matches nothing
+int editorPatternCompile(searchPattern *p, const char *query) {
+    *p = (searchPattern){0};
+    p->is_regex = (query[0] == '/' && query[1] != '/');
+    if (query[0] == '/') {
+        query++;
+    }
+    p->text = strdup(query);
+    p->len = strlen(query);
+    if (p->is_regex && p->len > 0 &&
+        !regexCompile(&p->re, p->text, E.pool_size)) {
+        editorPatternFree(p);
+        return 0;
+    }
+    return 1;
+}
+
+// where the first match of `p` at or after `from` in `s` (of length `n`)
+// starts, or -1. `*len` is set to the length of the match, which can be 0
+// for a regex. `worker` is the thread of the pool that asks
+int editorPatternFind(searchPattern *p, int worker, const char *s, int n,
+                      int from, int *len) {
+    if (p->len == 0 || from > n) {
+        return -1;
+    }
+    if (!p->is_regex) {
+        int at = editorSearchMem(&s[from], n - from, p->text, p->len);
+        *len = p->len;
+        return at == -1 ? -1 : from + at;
+    }
+    return regexFind(&p->re, worker, s, n, from, len);
+}
+
+// where to look for the match after the one at `at` of length `len`. Matches
+// don't overlap, and the one after an empty match starts a byte later at least
+int editorPatternAfter(int at, int len) { return at + (len > 0 ? len : 1); }
+
+// matches of `p` in `s` (of length `n`) that start before `cx`
+int editorPatternCount(searchPattern *p, int worker, const char *s, int n,
+                       int cx) {
+    int count = 0, len;
+    for (int at = editorPatternFind(p, worker, s, n, 0, &len);
+         at != -1 && at < cx;
+         at = editorPatternFind(p, worker, s, n, editorPatternAfter(at, len),
+                                &len)) {
+        count++;
+    }
+    return count;
+}
+
+// where the first match of the query at or after `cx` in `row` starts, or -1
+int editorSearchNext(erow *row, int cx, int *len) {
+    return editorPatternFind(&E.buf->search.pattern, 0, row->chars, row->size,
+                             cx, len);
+}
+
+// matches of the query in `row` that start before `cx`
+int editorSearchCount(erow *row, int cx) {
+    return editorPatternCount(&E.buf->search.pattern, 0, row->chars,
+                              row->size, cx);
+}
+
+void editorSearchListAdd(searchList *list, erow *row, int index, int count) {
+    if (list->len == list->cap) {
+        list->cap = editorGrowCap(list->cap, list->len + 1);
+        list->rows = realloc(list->rows, sizeof(searchRow) * list->cap);
+    }
+    list->rows[list->len].row = row;
+    list->rows[list->len].index = index;
+    list->rows[list->len].count = count;
+    list->rows[list->len].before = list->total;
+    list->len++;
+    list->total += count;
+}
+
+// add `row` to the index if the query is in it
+void editorSearchAdd(erow *row, int index) {
+    int count = editorSearchCount(row, row->size + 1);
+    if (count > 0) {
+        editorSearchListAdd(&E.buf->search.found, row, index, count);
+    }
+}
+
+// split the rows of the file into chunks of whole leaves, each of them
+// KILO_POOL_CHUNK rows or a leaf more. Returns how many, `*chunks` is to be
+// freed
+int editorRowChunks(rowChunk **chunks) {
+    int len = 0, cap = 0, start = 0;
+    *chunks = NULL;
+    for (rowLeaf *leaf = E.buf->rows_head; leaf; leaf = leaf->next) {
+        if (len == 0 || (*chunks)[len - 1].count >= KILO_POOL_CHUNK) {
+            if (len == cap) {
+                cap = editorGrowCap(cap, len + 1);
+                *chunks = realloc(*chunks, sizeof(rowChunk) * cap);
+            }
+            (*chunks)[len++] = (rowChunk){leaf, start, 0};
+        }
+        (*chunks)[len - 1].count += leaf->n;
+        start += leaf->n;
+    }
+    return len;
+}
+
+// the next row of a chunk. Unlike editorRowIterNext() it doesn't write to
+// the row, so the threads of the pool can walk the rows at the same time.
+// `it` starts at slot 0 of the chunk's leaf, one index before its first row
+erow *editorChunkRow(rowIter *it) {
+    while (it->slot == it->leaf->n) {
+        it->leaf = it->leaf->next;
+        it->slot = 0;
+    }
+    it->index++;
+    return &it->leaf->rows[it->slot++];
+}
 
-    static int saved_hl_line;
-    static char *saved_hl = NULL;
+// find-all on the pool: list the rows of a chunk that have matches
+void editorSearchChunk(void *arg, int chunk, int worker) {
+    searchJob *job = arg;
+    rowChunk *c = &job->chunks[chunk];
+    searchList *list = &job->found[chunk];
+    rowIter it = {c->leaf, 0, c->start - 1};
+    for (int k = 0; k < c->count; k++) {
+        erow *row = editorChunkRow(&it);
+        int count = editorPatternCount(job->pattern, worker, row->chars,
+                                       row->size, row->size + 1);
+        if (count > 0) {
+            editorSearchListAdd(list, row, it.index, count);
+        }
+    }
+}
+
+// fill the index with every match of the query in the file. The chunks are
+// searched on the pool and their lists joined in file order afterwards
+void editorSearchAll() {
+    rowChunk *chunks;
+    int n = editorRowChunks(&chunks);
+    searchList *found = calloc(n > 0 ? n : 1, sizeof(searchList));
+    searchJob job = {&E.buf->search.pattern, chunks, found, NULL, 0, NULL};
+    poolTask task = {editorSearchChunk, &job, n, 0, 0};
+    editorPoolRun(&task);
+
+    searchList *S = &E.buf->search.found;
+    S->len = S->total = 0;
+    for (int i = 0; i < n; i++) {
+        searchList *l = &found[i];
+        if (S->len + l->len > S->cap) {
+            S->cap = editorGrowCap(S->cap, S->len + l->len);
+            S->rows = realloc(S->rows, sizeof(searchRow) * S->cap);
+        }
+        // `before` counted from the start of the chunk
+        for (int k = 0; k < l->len; k++) {
+            S->rows[S->len] = l->rows[k];
+            S->rows[S->len].before += S->total;
+            S->len++;
+        }
+        S->total += l->total;
+        free(l->rows);
+    }
+    free(found);
+    free(chunks);
+}
+
+// search the file for `query`. Rows are searched in their characters, not
+// in `render`, so nothing has to be rendered for it. If a plain query
+// contains the previous one, only the rows that matched that are looked at
+// again
+void editorSearchUpdate(const char *query) {
+    searchIndex *S = &E.buf->search;
+    searchPattern old = S->pattern;
+    S->invalid = !editorPatternCompile(&S->pattern, query);
+    int refine = !old.is_regex && !S->pattern.is_regex && old.len > 0 &&
+                 strstr(S->pattern.text, old.text);
+    editorPatternFree(&old);
+    S->generation++;
+    S->found.total = 0;
+    S->current = 0;
+    if (S->pattern.len == 0) {
+        S->found.len = 0;
+        return;
+    }
+
+    if (refine) {
+        // the index is refilled in place, it only gets shorter
+        int old_len = S->found.len;
+        S->found.len = 0;
+        for (int i = 0; i < old_len; i++) {
+            searchRow r = S->found.rows[i];
+            editorSearchAdd(r.row, r.index);
+        }
+        return;
+    }
+    editorSearchAll();
+}
+
+// the entry of the index for row `at`, or of the first row after it if `at`
+// has no matches (the length of the index if there is no such row)
+int editorSearchSlot(int at) {
+    int lo = 0, hi = E.buf->search.found.len;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (E.buf->search.found.rows[mid].index < at) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// find the match after (`direction` 1) or before (-1) the one at `*cy`,
+// `*cx` of length `*len`, wrapping around the ends of the file. With `*cy` at
+// -1, the first match of the file. Returns 0 if there are no matches
+int editorSearchStep(int *cy, int *cx, int *len, int direction) {
+    searchList *S = &E.buf->search.found;
+    if (S->len == 0) {
+        return 0;
+    }
+    int slot = editorSearchSlot(*cy);
+    int in_row = (*cy >= 0 && slot < S->len && S->rows[slot].index == *cy);
+    int m;
+    if (*cy < 0) {
+        slot = 0;
+        *cx = -1;
+    } else if (direction == 1) {
+        if (in_row) {
+            int at = editorSearchNext(S->rows[slot].row,
+                                      editorPatternAfter(*cx, *len), len);
+            if (at != -1) {
+                *cx = at;
+                return 1;
+            }
+            slot++;
+        }
+        slot %= S->len;
+        *cx = -1;
+    } else {
+        if (in_row) {
+            // the last match before the current one
+            erow *row = S->rows[slot].row;
+            int prev = -1, prev_len = 0;
+            for (int at = editorSearchNext(row, 0, &m); at != -1 && at < *cx;
+                 at = editorSearchNext(row, editorPatternAfter(at, m), &m)) {
+                prev = at;
+                prev_len = m;
+            }
+            if (prev != -1) {
+                *cx = prev;
+                *len = prev_len;
+                return 1;
+            }
+        }
+        slot = (slot + S->len - 1) % S->len;
+        *cx = INT_MAX;
+    }
+
+    // the first or the last match of the row
+    *cy = S->rows[slot].index;
+    erow *row = S->rows[slot].row;
+    if (*cx < 0) {
+        *cx = editorSearchNext(row, 0, len);
+    } else {
+        int last = -1;
+        for (int at = editorSearchNext(row, 0, &m); at != -1;
+             at = editorSearchNext(row, editorPatternAfter(at, m), &m)) {
+            last = at;
+            *len = m;
+        }
+        *cx = last;
+    }
+    return 1;
+}
+
+// the matches of the query in `row`, found again only when the row or the
+// query changed since the last time
+matchSpans *editorMatchSpans(erow *row) {
+    searchIndex *S = &E.buf->search;
+    matchSpans *m = &S->cache[row->index % KILO_MATCH_CACHE];
+    if (m->row == row && m->version == row->version &&
+        m->query == S->generation) {
+        return m;
+    }
+    m->row = row;
+    m->version = row->version;
+    m->query = S->generation;
+    m->count = 0;
+    int len;
+    for (int at = editorSearchNext(row, 0, &len); at != -1;
+         at = editorSearchNext(row, editorPatternAfter(at, len), &len)) {
+        if (m->count == m->cap) {
+            m->cap = editorGrowCap(m->cap, m->count + 1);
+            m->spans = realloc(m->spans, sizeof(int) * 2 * m->cap);
+        }
+        m->spans[2 * m->count] = at;
+        m->spans[2 * m->count + 1] = len;
+        m->count++;
+    }
+    return m;
+}
 
-    if (saved_hl) {
-        memcpy(E.rows[saved_hl_line].hl, saved_hl, E.rows[saved_hl_line].rsize);
-        free(saved_hl);
-        saved_hl = NULL;
+// show the matches in `row` on its screen `line` of `len` cells, the one the
+// cursor is on inverted
+void editorDrawMatches(screenCell *line, erow *row, int len) {
+    matchSpans *m = editorMatchSpans(row);
+    for (int k = 0; k < m->count; k++) {
+        int at = m->spans[2 * k], end = at + m->spans[2 * k + 1];
+        int from = editorRowCxToRx(row, at) - E.win->col_off;
+        if (from >= len) {
+            break;
+        }
+        int to = editorRowCxToRx(row, end) - E.win->col_off;
+        unsigned char attr = editorSyntaxToColor(HL_MATCH);
+        if (row->index == E.buf->search.match_y &&
+            at == E.buf->search.match_x) {
+            attr |= CELL_INVERSE;
+        }
+        for (int x = from > 0 ? from : 0; x < to && x < len; x++) {
+            line[x].attr = attr;
+        }
     }
+}
+
+void editorFindCallback(char *query, int key) {
+    searchIndex *S = &E.buf->search;
+    // 1 means next match, -1 means previous match
+    int direction = 1;
 
     if (key == '\r' || key == '\x1b') {
-        last_match = -1;
-        direction = 1;
+        S->match_y = -1;
         return;
     } else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
         direction = 1;
     } else if (key == ARROW_LEFT || key == ARROW_UP) {
         direction = -1;
     } else {
-        last_match = -1;
-        direction = 1;
+        // the query changed, start over from the top of the file
+        editorSearchUpdate(query);
+        S->match_y = -1;
+    }
+
+    if (!editorSearchStep(&S->match_y, &S->match_x, &S->match_len,
+                          direction)) {
+        S->match_y = -1;
+        S->current = 0;
+        return;
+    }
+    erow *row = editorRowAt(S->match_y);
+    int slot = editorSearchSlot(S->match_y);
+    S->current =
+        S->found.rows[slot].before + editorSearchCount(row, S->match_x) + 1;
+
+    E.win->cy = S->match_y;
+    E.win->cx = S->match_x;
+    // so that we are scrolled to the very bottom of the file, which will
+    // cause editorScroll() to scroll upwards at the next screen refresh so
+    // that the matching line will be at the very top of the screen
+    E.win->row_off = E.buf->num_rows;
+}
+
+// a new search of E.buf, which editorFindCallback() takes the query of
+void editorSearchBegin() {
+    // the rows are numbered differently after an edit, so the index is built
+    // anew for every search
+    editorPatternFree(&E.buf->search.pattern);
+    E.buf->search.invalid = 0;
+    E.buf->search.generation++;
+    E.buf->search.found.len = E.buf->search.found.total = 0;
+    E.buf->search.current = 0;
+    E.buf->search.match_y = -1;
+    E.buf->search.active = 1;
+}
+
+// every match in the file can be reached with the arrow keys, the status bar
+// counts them
+void editorFind() {
+    int saved_cx = E.win->cx, saved_cy = E.win->cy;
+    int saved_row_off = E.win->row_off, saved_col_off = E.win->col_off;
+
+    editorSearchBegin();
+    char *query = editorPrompt("Search: %s (/ for a regex, ESC/Arrows/Enter)",
+                               editorFindCallback, 0);
+    E.buf->search.active = 0;
+
+    if (query) {
+        free(query);
+    } else {
+        E.win->cx = saved_cx;
+        E.win->cy = saved_cy;
+        E.win->row_off = saved_row_off;
+        E.win->col_off = saved_col_off;
     }
+}
 
-    if (last_match == -1) {
-        direction = 1;
-    }
-    int current = last_match; // the index of the row we are searching
-
-    for (int i = 0; i < E.num_rows; i++) {
-        current += direction;
-        if (current == -1) { // 0 + -1, search backwards
-            current = E.num_rows - 1;
-        } else if (current == E.num_rows) { // num_rows-1 + 1, search forwards
-            current = 0;
-        }
-
-        erow *row = &E.rows[current];
-        // strstr: locate a substring in a string
-        // return a pointer if succeed, NULL otherwise
-        char *match = strstr(row->render, query);
-        if (match) {
-            last_match = current;
-            E.cy = last_match;
-            E.cx = match - row->render;
-            E.cx = editorRowRxToCx(row, match - row->render);
-            // so that we are scrolled to the very bottom of the file, which
-            // will cause editorScroll() to scroll upwards at the next screen
-            // refresh so that the matching line will be at the very top of the
-            // screen
-            E.row_off = E.num_rows;
-
-            saved_hl_line = current;
-            saved_hl = malloc(row->rsize);
-            memcpy(saved_hl, row->hl, row->rsize);
-            memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
-            break;
+// replace-all on the pool: work out the new text of the rows of a chunk that
+// have matches. The rows themselves are left alone
+void editorReplaceChunk(void *arg, int chunk, int worker) {
+    searchJob *job = arg;
+    searchPattern *p = job->pattern;
+    rowChunk *c = &job->chunks[chunk];
+    replaceList *list = &job->replaced[chunk];
+    rowIter it = {c->leaf, 0, c->start - 1};
+    for (int k = 0; k < c->count; k++) {
+        erow *row = editorChunkRow(&it);
+        int len;
+        int at = editorPatternFind(p, worker, row->chars, row->size, 0, &len);
+        if (at == -1) {
+            continue;
+        }
+        struct abuf out = ABUF_INIT;
+        abReserve(&out, row->size + 1);
+        int count = 0, last = 0;
+        while (at != -1) {
+            abAppend(&out, &row->chars[last], at - last);
+            abAppend(&out, job->with, job->with_len);
+            last = at + len;
+            count++;
+            at = editorPatternFind(p, worker, row->chars, row->size,
+                                   editorPatternAfter(at, len), &len);
+        }
+        abAppend(&out, &row->chars[last], row->size - last);
+
+        if (list->len == list->cap) {
+            list->cap = editorGrowCap(list->cap, list->len + 1);
+            list->rows = realloc(list->rows, sizeof(replaceRow) * list->cap);
         }
+        list->rows[list->len++] = (replaceRow){row, it.index, count, out.b,
+                                               out.len};
+        list->total += count;
     }
 }
 
-// we only search the first matched string in each line
-void editorFind() {
-    int saved_cx = E.cx, saved_cy = E.cy;
-    int saved_row_off = E.row_off, saved_col_off = E.col_off;
+// replace every match of `p` in the file with `with`. The pool works out the
+// new text of the rows, then they are all changed here in one go, in order,
+// as a single change of the file. Returns the number of matches, `*rows` is
+// set to the number of rows changed
+int editorReplaceAll(searchPattern *p, const char *with, int with_len,
+                     int *rows) {
+    rowChunk *chunks;
+    int n = editorRowChunks(&chunks);
+    replaceList *replaced = calloc(n > 0 ? n : 1, sizeof(replaceList));
+    searchJob job = {p, chunks, NULL, with, with_len, replaced};
+    poolTask task = {editorReplaceChunk, &job, n, 0, 0};
+    editorPoolRun(&task);
+
+    int total = 0;
+    *rows = 0;
+    for (int i = 0; i < n; i++) {
+        replaceList *l = &replaced[i];
+        for (int k = 0; k < l->len; k++) {
+            replaceRow *r = &l->rows[k];
+            erow *row = r->row;
+            editorUndoCopy(UNDO_DELETE, r->index, 0, row->chars, row->size);
+            editorUndoCopy(UNDO_INSERT, r->index, 0, r->chars, r->size);
+            editorRowReserve(row, r->size + 1);
+            memcpy(row->chars, r->chars, r->size);
+            editorRowsResized(r->index, r->size - row->size);
+            row->size = r->size;
+            row->chars[row->size] = '\0';
+            row->index = r->index;
+            // rows away from the screen only have their state updated
+            editorUpdateRow(row);
+            free(r->chars);
+        }
+        total += l->total;
+        *rows += l->len;
+        free(l->rows);
+    }
+    free(replaced);
+    free(chunks);
 
-    char *query =
-        editorPrompt("Search: %s (Use ESC/Arrows/Enter)", editorFindCallback);
+    if (total > 0) {
+        E.buf->dirty++;
+        // the cursor's row may be shorter now, or have other characters
+        editorClampCursor();
+    }
+    return total;
+}
 
-    if (query) {
+// replace every match of a query, plain or a regex like in editorFind(), with
+// the text typed next, which may be empty
+void editorReplace() {
+    char *query = editorPrompt("Replace: %s (/ for a regex, ESC to cancel)",
+                               NULL, 0);
+    if (query == NULL) {
+        return;
+    }
+    char *with = editorPrompt("Replace with: %s (ESC to cancel)", NULL, 1);
+    if (with == NULL) {
         free(query);
+        return;
+    }
+
+    searchPattern p;
+    if (!editorPatternCompile(&p, query)) {
+        editorSetStatusMessage("Not a valid regex: %s", &query[1]);
     } else {
-        E.cx = saved_cx;
-        E.cy = saved_cy;
-        E.row_off = saved_row_off;
-        E.col_off = saved_col_off;
+        int rows;
+        int count = editorReplaceAll(&p, with, strlen(with), &rows);
+        editorSetStatusMessage("Replaced %d matches in %d rows", count, rows);
     }
+    editorPatternFree(&p);
+    free(query);
+    free(with);
 }
 
 /*** append buffer ***/
 
-struct abuf {
-    char *b;
-    int len;
-};
-
-#define ABUF_INIT {NULL, 0}
-
-void abAppend(struct abuf *ab, const char *s, int len) {
+// make room for `len` more bytes. The buffer at least doubles whenever it
+// grows, so appending a few bytes at a time doesn't realloc() for each append
+int abReserve(struct abuf *ab, int len) {
+    if (ab->len + len <= ab->cap) {
+        return 0;
+    }
+    int cap = ab->cap ? ab->cap : 64;
+    while (cap < ab->len + len) {
+        cap *= 2;
+    }
     // realloc() will copy the contents of the old block to the new one, and
     // then free() the old one automatically
-    char *new = realloc(ab->b, ab->len + len);
-
+    char *new = realloc(ab->b, cap);
     if (new == NULL) {
-        return;
+        return -1;
     }
-
-    memcpy(&new[ab->len], s, len);
     ab->b = new;
+    ab->cap = cap;
+    return 0;
+}
+
+void abAppend(struct abuf *ab, const char *s, int len) {
+    if (abReserve(ab, len) == -1) {
+        return;
+    }
+    memcpy(&ab->b[ab->len], s, len);
     ab->len += len;
 }
 
-void abFree(struct abuf *ab) { free(ab->b); }
+// append the decimal digits of `n` (n >= 0)
+void abAppendNum(struct abuf *ab, int n) {
+    char buf[12];
+    int i = sizeof(buf);
+    do {
+        buf[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    abAppend(ab, &buf[i], sizeof(buf) - i);
+}
+
+// append CSI <a> <final>, or CSI <a> ; <b> <final> if `b` isn't negative
+void abAppendCsi(struct abuf *ab, int a, int b, char final) {
+    abAppend(ab, "\x1b[", 2);
+    abAppendNum(ab, a);
+    if (b >= 0) {
+        abAppend(ab, ";", 1);
+        abAppendNum(ab, b);
+    }
+    abAppend(ab, &final, 1);
+}
+
+void abFree(struct abuf *ab) {
+    free(ab->b);
+    ab->b = NULL;
+    ab->len = ab->cap = 0;
+}
 
 /*** input ***/
 
+// read the text of a bracketed paste into `ab`, up to the \x1b[201~ the
+// terminal sends after it. Line breaks are pasted as \r (or \r\n), they are
+// turned into \n
+void editorReadPaste(struct abuf *ab) {
+    int waits = 0;
+    char c;
+    while (1) {
+        if (editorReadByte(&c) != 1) {
+            // don't wait forever for a terminal that never ends the paste
+            if (++waits == 10) {
+                break;
+            }
+            continue;
+        }
+        waits = 0;
+        abAppend(ab, &c, 1);
+        if (ab->len >= 6 && memcmp(&ab->b[ab->len - 6], "\x1b[201~", 6) == 0) {
+            ab->len -= 6;
+            break;
+        }
+    }
+
+    int len = 0;
+    for (int i = 0; i < ab->len; i++) {
+        if (ab->b[i] == '\r') {
+            ab->b[len++] = '\n';
+            if (i + 1 < ab->len && ab->b[i + 1] == '\n') {
+                i++;
+            }
+        } else {
+            ab->b[len++] = ab->b[i];
+        }
+    }
+    ab->len = len;
+}
+
 // the if statements allow the caller to pass NULL for the callback, in case
-// they don't want to use a callback (when we prompt the user for a filename)
-char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
+// they don't want to use a callback (when we prompt the user for a filename).
+// Enter only takes an empty answer if `allow_empty` is set
+char *editorPrompt(char *prompt, void (*callback)(char *, int),
+                   int allow_empty) {
     size_t buf_size = 128;
     char *buf = malloc(buf_size);
 
@@ -945,12 +7147,40 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
         // the `prompt` is expected to be a format string containing a %s, which
         // is where the user's input will be displayed
         editorSetStatusMessage(prompt, buf);
-        editorRefreshScreen();
+        // keys that are already waiting are taken before drawing again
+        if (!editorInputPending()) {
+            editorRefreshScreen();
+        }
 
         int c = editorReadKey();
+        if (c == KEY_NONE) {
+            continue;
+        }
+        // pasted text is typed into the prompt, up to its first line break
+        if (c == PASTE_START) {
+            struct abuf paste = ABUF_INIT;
+            editorReadPaste(&paste);
+            for (int i = 0; i < paste.len && paste.b[i] != '\n'; i++) {
+                unsigned char ch = paste.b[i];
+                if (iscntrl(ch)) {
+                    continue;
+                }
+                if (buf_len == buf_size - 1) {
+                    buf_size *= 2;
+                    buf = realloc(buf, buf_size);
+                }
+                buf[buf_len++] = ch;
+                buf[buf_len] = '\0';
+            }
+            abFree(&paste);
+        }
         if (c == CTRL_KEY('h') || c == BACKSPACE) {
+            // the last character, with all of its bytes
             if (buf_len != 0) {
-                buf[--buf_len] = '\0';
+                do {
+                    buf_len--;
+                } while (buf_len > 0 && (buf[buf_len] & 0xc0) == 0x80);
+                buf[buf_len] = '\0';
             }
         }
         // press Escape to cancel the input prompt
@@ -962,14 +7192,14 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
             free(buf);
             return NULL;
         } else if (c == '\r') {
-            if (buf_len != 0) {
+            if (buf_len != 0 || allow_empty) {
                 editorSetStatusMessage("");
                 if (callback) {
                     callback(buf, c);
                 }
                 return buf;
             }
-        } else if (!iscntrl(c) && c < 128) {
+        } else if (c < 256 && !iscntrl(c)) {
             if (buf_len == buf_size - 1) {
                 buf_size *= 2;
                 buf = realloc(buf, buf_size);
@@ -985,88 +7215,151 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
 }
 
 void editorMoveCursor(int key) {
-    // E.cy is allowed to be oone past the last line of the file
-    erow *row = (E.cy >= E.num_rows) ? NULL : &E.rows[E.cy];
+    // cy is allowed to be oone past the last line of the file
+    erow *row = editorRowAt(E.win->cy);
 
     switch (key) {
     // prevent moving the cursor off screen
     case ARROW_LEFT:
-        if (E.cx != 0) {
-            E.cx--;
-        } else if (E.cy > 0) { // move left at the start of a line
-            E.cy--;
-            E.cx = E.rows[E.cy].size;
+        if (E.win->cx != 0) {
+            E.win->cx = editorRowStep(row, E.win->cx, -1);
+        } else if (E.win->cy > 0) { // move left at the start of a line
+            E.win->cy--;
+            E.win->cx = editorRowAt(E.win->cy)->size;
         }
         break;
     case ARROW_RIGHT:
-        if (row && E.cx < row->size) {
-            E.cx++;
-        } else if (E.cy < E.num_rows) { // move right at the end of a line
-            E.cy++;
-            E.cx = 0;
+        if (row && E.win->cx < row->size) {
+            E.win->cx = editorRowStep(row, E.win->cx, 1);
+        } else if (E.win->cy < E.buf->num_rows) {
+            // move right at the end of a line
+            E.win->cy++;
+            E.win->cx = 0;
         }
         break;
     case ARROW_DOWN:
-        if (E.cy < E.num_rows) {
-            E.cy++;
+        if (E.win->cy < E.buf->num_rows) {
+            E.win->cy++;
         }
         break;
     case ARROW_UP:
-        if (E.cy != 0) {
-            E.cy--;
+        if (E.win->cy != 0) {
+            E.win->cy--;
         }
         break;
     }
 
     // if we move the cursor to the end of a long line, then move it down, the
-    // E.cx won't change, and the cursor will be off to the right end of the
+    // cx won't change, and the cursor will be off to the right end of the
     // line it's now on, so we need to snap the cursor to end of line
-    row = (E.cy > E.num_rows) ? NULL : &E.rows[E.cy];
+    row = editorRowAt(E.win->cy);
     int row_len = row ? row->size : 0;
-    if (E.cx > row_len) {
-        E.cx = row_len;
+    if (E.win->cx > row_len) {
+        E.win->cx = row_len;
+    }
+    // nor in the middle of a character
+    if (row) {
+        E.win->cx = editorRowCharStart(row, E.win->cx);
     }
 }
+// clear the screen and reposition the cursor when the program exits
+void editorQuit() {
+    write(STDOUT_FILENO, "\x1b[2J", 4);
+    write(STDOUT_FILENO, "\x1b[H", 3);
+    exit(0);
+}
+
 // wait for a keypress, and then handles it
 // later, it will map various `Ctrl` key combinations and other special keys to
 //  different editor functions, and insert any alphanumeric and other printable
 //  key's characters into the text that is being edited
-void editorProcessKeypress() {
+void editorHandleKey(int c) {
     static int quit_times = KILO_QUIT_TIMES;
 
-    int c = editorReadKey();
+    editorUndoBoundary();
+    // any other key takes back a C-q that waits for a save
+    if (c != CTRL_KEY('q') && c != KEY_NONE) {
+        E.save_quit = 0;
+    }
     switch (c) {
     case '\r': // Enter
-        editorInsertNewline();
+        if (!editorReadOnly()) {
+            editorInsertNewline();
+        }
         break;
 
     case CTRL_KEY('q'): // C-q to quit
-        // If the file is dirty, we will display a warning, and require the
+        // with the screen split, only the window goes
+        if (E.num_wins > 1) {
+            editorCloseWindow();
+            break;
+        }
+        // during a save, the editor quits once it is done. Pressing C-q again
+        // cancels the save instead of waiting for it
+        if (editorBuffersSaving() && !E.save_quit) {
+            E.save_quit = 1;
+            editorSetStatusMessage("Quitting once the file is saved. "
+                                   "Press Ctrl-Q again to cancel the save.");
+            return;
+        }
+        if (editorBuffersSaving()) {
+            editorSaveCancel();
+        }
+        // If a file is dirty, we will display a warning, and require the
         // user to press C-q KILO_QUIT_TIMES more times in order to quit without
         // saving
-        if (E.dirty && quit_times > 0) {
+        if (editorBuffersDirty() && quit_times > 0) {
             editorSetStatusMessage("WARNING!!! File has unsaved changes. "
                                    "Press Ctrl-Q %d more times to quit.",
                                    quit_times);
             quit_times--;
             return;
         }
-        // clear the screen and reposition the cursor when the program exits
-        write(STDOUT_FILENO, "\x1b[2J", 4);
-        write(STDOUT_FILENO, "\x1b[H", 3);
-        exit(0);
+        editorQuit();
         break;
 
     case CTRL_KEY('w'): // C-w to save
-        editorSave();
+        if (!editorReadOnly()) {
+            editorSave();
+        }
+        break;
+
+    case CTRL_KEY('e'): // C-e to follow the file as it grows, or stop
+        if (E.buf->follow.fd != -1) {
+            editorFollowStop();
+        } else {
+            editorFollowStart();
+        }
+        break;
+
+    case CTRL_KEY('o'): // C-o to open another file
+        editorOpenPrompt();
+        break;
+
+    case CTRL_KEY('n'): // C-n to show the next open file
+        editorNextBuffer();
+        break;
+
+    case CTRL_KEY('t'): // C-t to split the window
+        editorSplitWindow();
         break;
 
+    case CTRL_KEY('x'): // C-x to go to the next window
+        editorNextWindow();
+        break;
+
+#if KILO_PROFILE
+    case CTRL_KEY('p'): // C-p to show where the time goes, or stop
+        E.profile.shown = !E.profile.shown;
+        break;
+#endif
+
     case HOME_KEY: // move the cursor to the beginning of the column
-        E.cx = 0;
+        E.win->cx = 0;
         break;
     case END_KEY: // move the cursor to the end of the column
-        if (E.cy < E.num_rows) {
-            E.cx = E.rows[E.cy].size;
+        if (E.win->cy < E.buf->num_rows) {
+            E.win->cx = editorRowAt(E.win->cy)->size;
         }
         break;
 
@@ -1074,35 +7367,67 @@ void editorProcessKeypress() {
         editorFind();
         break;
 
+    case CTRL_KEY('r'):
+        if (!editorReadOnly()) {
+            editorReplace();
+        }
+        break;
+
+    case CTRL_KEY('z'):
+        if (!editorReadOnly()) {
+            editorUndo();
+        }
+        break;
+
+    case CTRL_KEY('y'):
+        if (!editorReadOnly()) {
+            editorRedo();
+        }
+        break;
+
+    case PASTE_START: {
+        // read even if it is dropped, or it would be taken for keys
+        struct abuf paste = ABUF_INIT;
+        editorReadPaste(&paste);
+        if (!editorReadOnly()) {
+            editorInsertText(paste.b, paste.len);
+        }
+        abFree(&paste);
+        break;
+    }
+
     case BACKSPACE:
     case CTRL_KEY('h'):
     case DEL_KEY:
+        if (editorReadOnly()) {
+            break;
+        }
         if (c == DEL_KEY)
             editorMoveCursor(ARROW_RIGHT);
         editorDelChar();
         break;
 
     case PAGE_UP:
-    case PAGE_DOWN: {
+    case PAGE_DOWN:
+        // a screen up from the top of the screen, or down from its bottom,
+        // computed at once instead of pressing Up or Down that many times
         if (c == PAGE_UP) {
-            E.cy = E.row_off;
-        } else if (c == PAGE_DOWN) {
-            E.cy = E.row_off + E.screen_rows - 1;
-            if (E.cy > E.num_rows) {
-                E.cy = E.num_rows;
+            E.win->cy = E.win->row_off - E.win->screen_rows;
+            if (E.win->cy < 0) {
+                E.win->cy = 0;
+            }
+        } else {
+            E.win->cy = E.win->row_off + 2 * E.win->screen_rows - 1;
+            if (E.win->cy > E.buf->num_rows) {
+                E.win->cy = E.buf->num_rows;
             }
         }
+        editorClampCursor();
+        break;
 
-        // create a code block so that we are allowed to declare times variable
-        //  (we cannot declare variables directly inside a switch statement)
-        //  simulate the user pressing Up and Down keys enough times to move to
-        //  the top or bottom of the screen
-        int times = E.screen_rows;
-        while (times--) {
-            editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
-        }
+    case CTRL_KEY('g'):
+        editorGoTo();
         break;
-    }
 
     case ARROW_LEFT:
     case ARROW_RIGHT:
@@ -1113,50 +7438,156 @@ void editorProcessKeypress() {
 
     case CTRL_KEY('l'):
     case '\x1b':
+    case KEY_NONE:
         break;
     default:
-        editorInsertChar(c);
+        if (!editorReadOnly()) {
+            editorInsertChar(c);
+        }
         break;
     }
 
     quit_times = KILO_QUIT_TIMES;
 }
 
+// wait for a key and handle it
+void editorProcessKeypress() {
+    int c = editorReadKey();
+    PROFILE_BEGIN(start);
+    editorHandleKey(c);
+    PROFILE_END(PROFILE_KEY, start);
+}
+
 /*** output ***/
 
 void editorScroll() {
-    E.rx = E.cx;
-    if (E.cy < E.num_rows) {
-        E.rx = editorRowCxToRx(&E.rows[E.cy], E.cx);
+    E.win->rx = E.win->cx;
+    if (E.win->cy < E.buf->num_rows) {
+        E.win->rx = editorRowCxToRx(editorRowAt(E.win->cy), E.win->cx);
     }
 
     // check if the cursor is above the visible window, (we just move upward)
     // if so, scrolls up ...
-    if (E.cy < E.row_off) {
-        E.row_off = E.cy;
+    if (E.win->cy < E.win->row_off) {
+        E.win->row_off = E.win->cy;
     }
     // check if the cursor is below the visible window, (we just move downward)
     // if so, scrolls down ...
-    else if (E.cy >= E.row_off + E.screen_rows) {
-        E.row_off = E.cy - E.screen_rows + 1;
+    else if (E.win->cy >= E.win->row_off + E.win->screen_rows) {
+        E.win->row_off = E.win->cy - E.win->screen_rows + 1;
+    }
+
+    if (E.win->rx < E.win->col_off) {
+        E.win->col_off = E.win->rx;
+    } else if (E.win->rx >= E.win->col_off + E.screen_cols) {
+        E.win->col_off = E.win->rx - E.screen_cols + 1;
+    }
+}
+
+// make sure the screen buffers match the size of the window. A new size means
+// the terminal has to be repainted completely
+void editorScreenResize() {
+    int h = E.screen_rows + 2, w = E.screen_cols;
+    if (h == E.screen_h && w == E.screen_w) {
+        return;
+    }
+    E.screen_back = realloc(E.screen_back, sizeof(screenCell) * h * w);
+    E.screen_front = realloc(E.screen_front, sizeof(screenCell) * h * w);
+    E.line_hash_back =
+        realloc(E.line_hash_back, sizeof(unsigned long long) * h);
+    E.line_hash_front =
+        realloc(E.line_hash_front, sizeof(unsigned long long) * h);
+    // every cell changing its attributes, a cursor move and an erase on every
+    // line, and the scrolling and cursor sequences around them
+    abReserve(&E.frame,
+              h * (w * (CELL_SGR_MAX + CELL_BYTES) + 16) + h * 2 + 64);
+    E.screen_h = h;
+    E.screen_w = w;
+    E.front_valid = 0;
+}
+
+// line `y` of the frame being drawn
+screenCell *editorScreenLine(int y) { return &E.screen_back[y * E.screen_w]; }
+
+// put the character at the start of the `n` bytes at `s` at column `x` of
+// `line`, with its length in `*len`, and return the column after it. What
+// can't be shown is inverted: a control character as the letter that types it
+// (A-Z is after @), anything else as '?'. Zero width characters go into the
+// cell before them, and a wide character that doesn't fit at the right edge
+// leaves a blank
+int editorPutChar(screenCell *line, int x, const char *s, int n, int *len,
+                  unsigned char attr) {
+    int w = editorUtf8Width(s, n, len);
+    screenCell *cell = &line[x];
+    if (w == 0) {
+        // the cell before, or the left half of the wide character before
+        int at = x - 1;
+        if (at > 0 && line[at].len == 0) {
+            at--;
+        }
+        if (at >= 0 && line[at].len + *len <= CELL_BYTES) {
+            memcpy(&line[at].ch[line[at].len], s, *len);
+            line[at].len += *len;
+        }
+        return x;
     }
+    cell->len = 1;
+    if (w < 0) {
+        unsigned char c = s[0];
+        cell->ch[0] = (c <= 26) ? '@' + c : '?';
+        cell->attr = CELL_INVERSE;
+        return x + 1;
+    }
+    cell->attr = attr;
+    if (x + w > E.screen_w) {
+        cell->ch[0] = ' ';
+        return x + 1;
+    }
+    memcpy(cell->ch, s, *len);
+    cell->len = *len;
+    if (w == 2) {
+        line[x + 1].len = 0;
+        line[x + 1].attr = attr;
+    }
+    return x + w;
+}
 
-    if (E.rx < E.col_off) {
-        E.col_off = E.rx;
-    } else if (E.rx >= E.col_off + E.screen_cols) {
-        E.col_off = E.rx - E.screen_cols + 1;
+// put the `len` bytes of text at `s` with attribute `attr` at column `x` of
+// `line`, as far as they fit, and return the column after them
+int editorPutText(screenCell *line, int x, const char *s, int len,
+                  unsigned char attr) {
+    for (int i = 0, n; i < len && x < E.screen_w; i += n) {
+        x = editorPutChar(line, x, &s[i], len - i, &n, attr);
     }
+    return x;
 }
 
-void editorDrawRows(struct abuf *ab) {
+// blank the rest of `line` from column `x` on
+void editorPutBlank(screenCell *line, int x, unsigned char attr) {
+    for (; x < E.screen_w; x++) {
+        line[x].ch[0] = ' ';
+        line[x].len = 1;
+        line[x].attr = attr;
+    }
+}
+
+void editorDrawRows() {
+    // only the rows on the screen (and the ones above them that have not been
+    // highlighted yet) need their `render` and `hl`
+    editorPrepareRows(E.win->row_off, E.win->row_off + E.win->screen_rows);
+
+    rowIter it;
+    erow *row = editorRowIterStart(&it, E.win->row_off);
+
     // draw tildes at the beginning of each lines
     //  which means that row is not part of the file and can't contain any text
-    for (int screen_row = 0; screen_row < E.screen_rows; screen_row++) {
-        int file_row = screen_row + E.row_off;
-        if (file_row >= E.num_rows) { // draw rows without texts
+    for (int screen_row = 0; screen_row < E.win->screen_rows; screen_row++) {
+        screenCell *line = editorScreenLine(E.win->top + screen_row);
+        int x = 0;
+        if (row == NULL) { // draw rows without texts
             // display when starting the program with on arguments, and not when
             // opening a file
-            if (E.num_rows == 0 && screen_row == E.screen_rows / 3) {
+            if (E.buf->num_rows == 0 && screen_row == E.win->screen_rows / 3) {
                 char welcome[80];
                 // snprintf(char *restrict str, size_t size, const char
                 // *restrict
@@ -1171,146 +7602,443 @@ void editorDrawRows(struct abuf *ab) {
                 // center the welcome
                 int padding = (E.screen_cols - welcome_len) / 2;
                 if (padding) {
-                    abAppend(ab, "~", 1);
+                    x = editorPutText(line, x, "~", 1, 0);
                     padding--;
                 }
                 while (padding--) {
-                    abAppend(ab, " ", 1);
+                    x = editorPutText(line, x, " ", 1, 0);
                 }
-                abAppend(ab, welcome, welcome_len);
+                x = editorPutText(line, x, welcome, welcome_len, 0);
             } else {
-                // \x1b[K:  clear each line as we draw them, argument 0 erases
-                // the part of the line to the right of the cursor
-                abAppend(ab, "~", 1);
+                x = editorPutText(line, x, "~", 1, 0);
             }
         } else {
-            int len = E.rows[file_row].rsize - E.col_off;
-            if (len < 0) {
-                len = 0;
-            } else if (len > E.screen_cols) {
-                len = E.screen_cols;
-            }
-
-            char *c = &E.rows[file_row].render[E.col_off];
-            unsigned char *hl = &E.rows[file_row].hl[E.col_off];
-            int current_color = -1;
-            // We don't have to write out an escape sequence before every single
-            // character. Instead we only print out an escape sequence when the
-            // color changes
-            for (int i = 0; i < len; i++) {
-                // translate nonprintable characters into A-Z or ?
-                if (iscntrl(c[i])) {
-                    // A-Z is after @
-                    char sym = (c[i] <= 26) ? '@' + c[i] : '?';
-                    abAppend(ab, "\x1b[7m", 4);
-                    abAppend(ab, &sym, 1);
-                    abAppend(ab, "\x1b[m", 3);
-
-                    if (current_color != -1) {
-                        char buf[16];
-                        int clen = snprintf(buf, sizeof(buf), "\x1b[%dm",
-                                            current_color);
-                        abAppend(ab, buf, clen);
-                    }
-                }
-                if (hl[i] == HL_NORMAL) {
-                    if (current_color != -1) {
-                        abAppend(ab, "\x1b[39m", 5);
-                        current_color = -1;
-                    }
-                    abAppend(ab, &c[i], 1);
+            // the first byte of `render` on the screen. A tab cut by the left
+            // edge shows the rest of its spaces, a wide character a blank
+            rowView *v = row->view;
+            int ri = E.win->col_off;
+            colChar *c = editorColsAtColumn(v->cols, E.win->col_off);
+            if (c) {
+                int end = c->rx + c->w;
+                if (E.win->col_off >= end) {
+                    ri = c->ri + c->rlen + (E.win->col_off - end);
+                } else if (row->chars[c->cx] == '\t') {
+                    ri = c->ri + (E.win->col_off - c->rx);
+                } else if (E.win->col_off == c->rx) {
+                    ri = c->ri;
                 } else {
-                    int color = editorSyntaxToColor(hl[i]);
-                    if (color != current_color) {
-                        current_color = color;
-                        char buf[16];
-                        int clen =
-                            snprintf(buf, sizeof(buf), "\x1b[%dm", color);
-                        abAppend(ab, buf, clen);
+                    ri = c->ri + c->rlen;
+                    while (x < end - E.win->col_off) {
+                        x = editorPutText(line, x, " ", 1, 0);
                     }
-                    abAppend(ab, &c[i], 1);
                 }
             }
-            // make sure the text color is reset to default finally
-            abAppend(ab, "\x1b[39m", 5);
+
+            while (ri < v->rsize && x < E.screen_cols) {
+                int hl = v->hl[ri], n;
+                int attr = hl == HL_NORMAL ? 0 : editorSyntaxToColor(hl);
+                x = editorPutChar(line, x, &v->render[ri], v->rsize - ri,
+                                  &n, attr);
+                ri += n;
+            }
+            if (E.buf->search.active && E.buf->search.pattern.len > 0) {
+                editorDrawMatches(line, row, x);
+            }
+            row = editorRowIterNext(&it);
         }
 
         // clean up the rest of the line
-        abAppend(ab, "\x1b[K", 3);
-
-        abAppend(ab, "\r\n", 2);
+        editorPutBlank(line, x, 0);
     }
 }
 
-void editorDrawStatusBar(struct abuf *ab) {
-    // switch to inverted colors (black text on a white background)
-    abAppend(ab, "\x1b[7m", 4);
-    char status[80], rstatus[80];
+void editorDrawStatusBar() {
+    // inverted colors (black text on a white background)
+    screenCell *line = editorScreenLine(E.win->top + E.win->screen_rows);
+    char status[80], rstatus[120], state[20];
+    // whether the file has unsaved changes, or how far saving it got
+    if (E.buf->save_job) {
+        E.buf->save_shown = editorSaveProgress();
+        snprintf(state, sizeof(state), "(saving %d%%)", E.buf->save_shown);
+    } else if (E.buf->follow.fd != -1) {
+        snprintf(state, sizeof(state), "(following)");
+    } else {
+        snprintf(state, sizeof(state), "%s", E.buf->dirty ? "(modified)" : "");
+    }
     // file name
     int len = snprintf(status, sizeof(status), "%.20s - %d lines %s",
-                       E.file_name ? E.file_name : "[No Name]", E.num_rows,
-                       E.dirty ? "(modified)" : "");
-    // current position
-    int progress = (E.cy + 1) * 100 / E.num_rows;
-    int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d:%d | %d%%",
-                        E.syntax ? E.syntax->file_type : "no ft", E.cy + 1,
-                        E.num_rows, progress);
-    if (len > E.screen_cols) {
-        len = E.screen_cols;
+                       E.buf->file_name ? E.buf->file_name : "[No Name]",
+                       E.buf->num_rows,
+                       state);
+    // current position, the byte the cursor is on out of the bytes of the file
+    long long total = editorRowsBytes();
+    long long offset = editorRowOffset(E.win->cy) + E.win->cx;
+    int progress = total > 0 ? (int)(offset * 100 / total) : 100;
+    int rlen = 0;
+    // while searching, which match the cursor is on out of how many
+    if (E.buf->search.active && E.buf->search.invalid) {
+        rlen = snprintf(rstatus, sizeof(rstatus), "not a valid regex | ");
+    } else if (E.buf->search.active) {
+        rlen = snprintf(rstatus, sizeof(rstatus), "%d/%d matches | ",
+                        E.buf->search.current, E.buf->search.found.total);
     }
-    abAppend(ab, status, len);
+    rlen += snprintf(&rstatus[rlen], sizeof(rstatus) - rlen,
+                     "%s | %d:%d | byte %lld of %lld (%d%%)",
+                     E.buf->syntax ? E.buf->syntax->file_type : "no ft",
+                     E.win->cy + 1,
+                     E.buf->num_rows, offset, total, progress);
+    if (rlen >= (int)sizeof(rstatus)) {
+        rlen = sizeof(rstatus) - 1;
+    }
+    int x = editorPutText(line, 0, status, len, CELL_INVERSE);
 
-    while (len < E.screen_cols) {
-        if (E.screen_cols - len == rlen) {
-            abAppend(ab, rstatus, rlen);
-            break;
-        } else {
-            abAppend(ab, " ", 1);
-            len++;
-        }
+    editorPutBlank(line, x, CELL_INVERSE);
+    // the right part only shows if it fits next to the left one
+    if (E.screen_cols - x >= rlen) {
+        editorPutText(line, E.screen_cols - rlen, rstatus, rlen, CELL_INVERSE);
     }
-    // switch back to normal formatting
-    abAppend(ab, "\x1b[m", 3);
-    abAppend(ab, "\r\n", 2);
 }
 
-void editorDrawMessageBar(struct abuf *ab) {
-    // clear the message bar
-    abAppend(ab, "\x1b[K", 3);
+void editorDrawMessageBar() {
+    screenCell *line = editorScreenLine(E.screen_rows + 1);
     int msg_len = strlen(E.statusmsg);
-    if (msg_len > E.screen_cols) {
-        msg_len = E.screen_cols;
-    }
+    int x = 0;
     // display 5 seconds
     if (msg_len && time(NULL) - E.statusmsg_time < 5) {
-        abAppend(ab, E.statusmsg, msg_len);
+        x = editorPutText(line, 0, E.statusmsg, msg_len, 0);
     }
+    editorPutBlank(line, x, 0);
 }
 
-void editorRefreshScreen() {
-    editorScroll();
+#if KILO_PROFILE
+// the overlay at the right of the message bar: the time the last key and the
+// last frame took, the time highlighting took since the frame before, and
+// what went to the kernel and the allocator meanwhile
+void editorDrawProfile() {
+    editorProfile *P = &E.profile;
+    char text[160];
+    int len = snprintf(text, sizeof(text),
+                       " key %.3fms | syntax %.3fms (%d) | draw %.3fms | "
+                       "%lluB out | %llu rd %llu wr | %llu alloc ",
+                       P->last.spent[PROFILE_KEY] / 1e6,
+                       P->last.spent[PROFILE_SYNTAX] / 1e6,
+                       P->last.calls[PROFILE_SYNTAX],
+                       P->last.spent[PROFILE_DRAW] / 1e6, P->last.bytes,
+                       P->last.reads, P->last.writes, P->last.allocs);
+    if (len >= (int)sizeof(text)) {
+        len = sizeof(text) - 1;
+    }
+    int x = E.screen_cols - len;
+    if (x < 0) {
+        x = 0;
+        len = E.screen_cols;
+    }
+    editorPutText(editorScreenLine(E.screen_rows + 1), x, text, len,
+                  CELL_INVERSE);
+}
+#endif
+
+// fill in `E.sgr` for all the cell attributes, so frames only copy them
+void editorBuildSgr() {
+    for (int attr = 0; attr < 256; attr++) {
+        struct abuf ab = ABUF_INIT;
+        abAppend(&ab, "\x1b[0", 3);
+        if (attr & CELL_INVERSE) {
+            abAppend(&ab, ";7", 2);
+        }
+        int fg = attr & ~CELL_INVERSE;
+        if (fg) {
+            abAppend(&ab, ";", 1);
+            abAppendNum(&ab, fg);
+        }
+        abAppend(&ab, "m", 1);
+        memcpy(E.sgr[attr], ab.b, ab.len);
+        E.sgr_len[attr] = ab.len;
+        abFree(&ab);
+    }
+}
+
+// switch the terminal to the attributes `attr` of a cell
+void editorEmitAttr(struct abuf *ab, unsigned char attr) {
+    abAppend(ab, E.sgr[attr], E.sgr_len[attr]);
+}
+
+// a space with the default attributes
+int editorCellIsBlank(screenCell *cell) {
+    return cell->len == 1 && cell->ch[0] == ' ' && cell->attr == 0;
+}
+
+// send the cells [x0, x1] of line `y` of the frame. `attr` tracks the
+// attributes the terminal is set to (-1 if unknown)
+void editorEmitSpan(struct abuf *ab, int y, int x0, int x1, int *attr) {
+    screenCell *line = editorScreenLine(y);
+    // the right half of a wide character comes with its left half
+    if (x0 > 0 && line[x0].len == 0) {
+        x0--;
+    }
+    abAppendCsi(ab, y + 1, x0 + 1, 'H');
+
+    // a blank end of the line is erased instead of written out, which needs
+    // the default attributes
+    int blank = E.screen_w;
+    while (blank > x0 && editorCellIsBlank(&line[blank - 1])) {
+        blank--;
+    }
+    int erase = (x1 >= blank && E.screen_w - blank > 3);
+    int end = erase ? blank - 1 : x1;
+
+    // the cells are copied straight into the buffer, with room made for
+    // all of them changing attributes
+    if (abReserve(ab, (end - x0 + 1) * (CELL_SGR_MAX + CELL_BYTES)) == -1) {
+        return;
+    }
+    char *p = &ab->b[ab->len];
+    for (int x = x0; x <= end; x++) {
+        if (line[x].attr != *attr) {
+            *attr = line[x].attr;
+            memcpy(p, E.sgr[*attr], E.sgr_len[*attr]);
+            p += E.sgr_len[*attr];
+        }
+        memcpy(p, line[x].ch, line[x].len);
+        p += line[x].len;
+    }
+    ab->len = p - ab->b;
+    if (erase) {
+        if (*attr != 0) {
+            editorEmitAttr(ab, 0);
+            *attr = 0;
+        }
+        // \x1b[K: erase the line to the right of the cursor
+        abAppend(ab, "\x1b[K", 3);
+    }
+}
+
+// FNV-1a over the cells of a line, or 0 if the line is blank. Equal hashes
+// only steer which way the screen is scrolled, the cells are still compared
+// one by one afterwards
+unsigned long long editorLineHash(screenCell *line) {
+    unsigned long long h = 14695981039346656037ull;
+    int blank = 1;
+    for (int x = 0; x < E.screen_w; x++) {
+        for (int i = 0; i < line[x].len; i++) {
+            h = (h ^ (unsigned char)line[x].ch[i]) * 1099511628211ull;
+        }
+        h = (h ^ line[x].len) * 1099511628211ull;
+        h = (h ^ line[x].attr) * 1099511628211ull;
+        blank &= editorCellIsBlank(&line[x]);
+    }
+    return blank ? 0 : h | 1;
+}
+
+// move the lines [top, bottom) of `screen_front` up by `d` lines (down if `d`
+// is negative), like the terminal does when it scrolls that region. The lines
+// scrolled in are blank
+void editorScreenShift(int top, int bottom, int d) {
+    int w = E.screen_w;
+    int n = bottom - top - (d > 0 ? d : -d);
+    screenCell *region = &E.screen_front[top * w];
+    if (d > 0) {
+        memmove(region, &region[d * w], sizeof(screenCell) * n * w);
+    } else {
+        memmove(&region[-d * w], region, sizeof(screenCell) * n * w);
+    }
+    int blank_from = d > 0 ? bottom - d : top;
+    for (int y = 0; y < (d > 0 ? d : -d); y++) {
+        editorPutBlank(&E.screen_front[(blank_from + y) * w], 0, 0);
+    }
+}
+
+// When the view scrolls, or rows are inserted or deleted, most lines of the
+// new frame are already on the screen, just somewhere else. Find the shift of
+// the text area below its first changed line that puts the most of them in
+// place, and if that saves more than a line, let the terminal move them:
+// with a scroll region (DECSTBM) and CSI S / CSI T, or line feeds and reverse
+// index at its edges on VT100s, or by scrolling the whole screen (status bars
+// included, they are simply drawn again) if the terminal didn't say what it
+// is. `screen_front` is shifted the same way, and the diff does the rest
+void editorScrollScreen(struct abuf *ab) {
+    int rows = E.screen_rows;
+    for (int y = 0; y < rows; y++) {
+        E.line_hash_back[y] = editorLineHash(editorScreenLine(y));
+        E.line_hash_front[y] = editorLineHash(&E.screen_front[y * E.screen_w]);
+    }
+    int top = 0;
+    while (top < rows && E.line_hash_back[top] == E.line_hash_front[top]) {
+        top++;
+    }
+    if (top == rows || (E.term_level == 0 && top > 0)) {
+        return;
+    }
+
+    // blank lines would match anywhere, only lines with text count
+    int best_d = 0, best = -1, in_place = 0;
+    for (int d = -(rows - top - 1); d < rows - top; d++) {
+        int matches = 0;
+        for (int y = top; y < rows; y++) {
+            int from = y + d;
+            if (from >= top && from < rows && E.line_hash_back[y] != 0 &&
+                E.line_hash_back[y] == E.line_hash_front[from]) {
+                matches++;
+            }
+        }
+        if (d == 0) {
+            in_place = matches;
+        } else if (matches > best) {
+            best = matches;
+            best_d = d;
+        }
+    }
+    if (best - in_place < 2) {
+        return;
+    }
+
+    int d = best_d, n = d > 0 ? d : -d;
+    if (E.term_level == 0) {
+        // line feeds at the bottom of the screen scroll it up, reverse index
+        // (ESC M) at the top scrolls it down
+        abAppendCsi(ab, d > 0 ? E.screen_h : 1, 1, 'H');
+        for (int i = 0; i < n; i++) {
+            abAppend(ab, d > 0 ? "\n" : "\x1bM", d > 0 ? 1 : 2);
+        }
+        editorScreenShift(0, E.screen_h, d);
+        return;
+    }
+
+    abAppendCsi(ab, top + 1, rows, 'r');
+    if (E.term_level >= 2) {
+        abAppendCsi(ab, n, -1, d > 0 ? 'S' : 'T');
+    } else {
+        abAppendCsi(ab, d > 0 ? rows : top + 1, 1, 'H');
+        for (int i = 0; i < n; i++) {
+            abAppend(ab, d > 0 ? "\n" : "\x1bM", d > 0 ? 1 : 2);
+        }
+    }
+    // reset the scroll region to the whole screen
+    abAppend(ab, "\x1b[r", 3);
+    editorScreenShift(top, rows, d);
+}
+
+int editorCellsDiffer(screenCell *a, screenCell *b) {
+    return a->len != b->len || a->attr != b->attr ||
+           memcmp(a->ch, b->ch, a->len) != 0;
+}
+
+// differing spans of a line that are closer than this are sent as one, since
+// moving the cursor costs about as much as resending those cells
+#define SCREEN_SPAN_GAP 8
+
+// send every line of the frame that differs from what the terminal shows,
+// only the spans that changed when possible
+void editorFlushScreen(struct abuf *ab) {
+    if (E.front_valid) {
+        editorScrollScreen(ab);
+    }
+    int attr = -1;
+    for (int y = 0; y < E.screen_h; y++) {
+        screenCell *back = editorScreenLine(y);
+        screenCell *front = &E.screen_front[y * E.screen_w];
+        if (!E.front_valid) {
+            editorEmitSpan(ab, y, 0, E.screen_w - 1, &attr);
+            continue;
+        }
 
-    struct abuf ab = ABUF_INIT;
-    // \x1b[?25l: make the cursor invisible
-    abAppend(&ab, "\x1b[?25l", 6);
-    // \x1b[H: reposition the cursor at the top-left corner
-    abAppend(&ab, "\x1b[H", 3);
+        // the terminal may not agree with editorCharWidth() on every
+        // character, so lines with more than ASCII are sent as a whole
+        int whole = 0;
+        for (int x = 0; x < E.screen_w && !whole; x++) {
+            whole = back[x].len != 1 || front[x].len != 1 ||
+                    ((back[x].ch[0] | front[x].ch[0]) & 0x80);
+        }
 
-    editorDrawRows(&ab);
-    editorDrawStatusBar(&ab);
-    editorDrawMessageBar(&ab);
+        int x = 0;
+        while (x < E.screen_w) {
+            if (!editorCellsDiffer(&back[x], &front[x])) {
+                x++;
+                continue;
+            }
+            if (whole) {
+                editorEmitSpan(ab, y, 0, E.screen_w - 1, &attr);
+                break;
+            }
+            int start = x, last = x;
+            for (x++; x < E.screen_w && x - last <= SCREEN_SPAN_GAP; x++) {
+                if (editorCellsDiffer(&back[x], &front[x])) {
+                    last = x;
+                }
+            }
+            editorEmitSpan(ab, y, start, last, &attr);
+            x = last + 1;
+        }
+    }
+    if (attr > 0) {
+        editorEmitAttr(ab, 0);
+    }
+    memcpy(E.screen_front, E.screen_back,
+           sizeof(screenCell) * E.screen_h * E.screen_w);
+    E.front_valid = 1;
+}
 
-    // move the cursor to the position stored in E.cx and E.cy
-    char buf[32];
-    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.row_off) + 1,
-             (E.rx - E.col_off) + 1);
-    abAppend(&ab, buf, strlen(buf));
+void editorRefreshScreen() {
+    PROFILE_BEGIN(start);
+    // neither this frame nor the keys after it may read what a truncated
+    // file lost
+    editorMapCheck();
+    editorHlThreadSync();
+    editorScreenResize();
+
+    // every window is drawn as E.win, the other windows' cursors may have to
+    // follow the changes made in front
+    editorWindow *win = E.win;
+    for (int i = 0; i < E.num_wins; i++) {
+        E.win = &E.wins[i];
+        E.buf = E.win->buf;
+        if (E.win != win) {
+            editorClampCursor();
+        }
+        editorScroll();
+        editorDrawRows();
+        editorDrawStatusBar();
+    }
+    E.win = win;
+    E.buf = win->buf;
+    editorDrawMessageBar();
+#if KILO_PROFILE
+    if (E.profile.shown) {
+        editorDrawProfile();
+    }
+#endif
+
+    struct abuf *ab = &E.frame;
+    ab->len = 0;
+    // \x1b[?25l: make the cursor invisible while the lines are redrawn
+    abAppend(ab, "\x1b[?25l", 6);
+    editorFlushScreen(ab);
+    int redrawn = (ab->len > 6);
+    if (!redrawn) {
+        ab->len = 0;
+    }
 
-    // show the cursor immediately after the refresh finishes
-    abAppend(&ab, "\x1b[?25h", 6);
+    int cy = E.win->top + E.win->cy - E.win->row_off;
+    int cx = E.win->rx - E.win->col_off;
+    if (redrawn || cy != E.cursor_y || cx != E.cursor_x) {
+        // move the cursor to the position stored in the window's cx and cy,
+        // a frame in which only the cursor moved sends nothing else
+        abAppendCsi(ab, cy + 1, cx + 1, 'H');
+        E.cursor_y = cy;
+        E.cursor_x = cx;
+    }
+    if (redrawn) {
+        // show the cursor immediately after the refresh finishes
+        abAppend(ab, "\x1b[?25h", 6);
+    }
 
-    write(STDOUT_FILENO, ab.b, ab.len);
-    abFree(&ab);
+    if (ab->len > 0) {
+        write(STDOUT_FILENO, ab->b, ab->len);
+    }
+    PROFILE_END(PROFILE_DRAW, start);
+#if KILO_PROFILE
+    editorProfileFrame();
+#endif
 }
 
 // ... makes it a variadic function
@@ -1336,27 +8064,57 @@ void editorSetStatusMessage(const char *fmt, ...) {
 /*** init ***/
 
 void initEditor() {
-    E.cx = 0;
-    E.cy = 0;
-    E.rx = 0;
-    E.row_off = 0;
-    E.col_off = 0;
-    E.num_rows = 0;
-    E.rows = NULL;
-    E.dirty = 0;
-    E.file_name = NULL;
+    E.bufs = NULL;
+    E.num_bufs = E.bufs_cap = 0;
+    E.version_clock = 0;
+    E.syntax_slots = NULL;
+    E.syntax_used = 0;
+    editorCacheInit();
+    // one window on an empty buffer, with no filetype
+    E.buf = editorBufferNew();
+    E.num_wins = 1;
+    E.win = &E.wins[0];
+    *E.win = (editorWindow){0};
+    E.win->buf = E.buf;
+    E.map_retired = NULL;
+    E.map_retired_len = 0;
+    E.save_quit = 0;
+    E.inotify_fd = -1;
+    E.follow_frame_at = 0;
+    E.follow_pending = 0;
     E.statusmsg[0] = '\0';
-    E.syntax = NULL; // no filetype for current file
     E.statusmsg_time = 0;
+    E.screen_back = E.screen_front = NULL;
+    E.screen_w = E.screen_h = 0;
+    E.front_valid = 0;
+    E.cursor_y = E.cursor_x = -1;
+    E.line_hash_back = E.line_hash_front = NULL;
+    E.frame = (struct abuf)ABUF_INIT;
+    editorBuildSgr();
+    editorEventsInit();
+#if KILO_PROFILE
+    editorProfileInit();
+#endif
+    editorHlThreadStart();
+    editorPoolInit();
+
+    // until the terminal tells, a size every terminal has
+    E.size_query_at = 0;
+    editorSetScreenSize(24, 80);
+    editorSyntaxInit();
+}
 
-    if (getWindowSize(&E.screen_rows, &E.screen_cols) == -1) {
-        die("getWindowSize");
-    }
-    // make room for a two-line status (file name, cursor position, etc.) and
-    //  message bar at the bottom of the screen
-    E.screen_rows -= 2;
+// find out about the terminal, after initEditor(). Nothing else in the core
+// needs one, so the benchmarks in bench.c run without it
+void initTerminal() {
+    enableRawMode();
+    editorUpdateWindowSize();
+    editorQueryTerminal();
 }
 
+// KILO_HEADLESS leaves main() out, to build the editor into a program of its
+// own, see bench.c
+#ifndef KILO_HEADLESS
 // argc: The total number of arguments passed, including the name of the
 //  program itseflf
 // argv: The actual text of the arguments.
@@ -1365,20 +8123,690 @@ void initEditor() {
 //      argv[1]: The first user-provided argument
 //      argv[2]: The second argument, and so on
 int main(int argc, char *argv[]) {
-    enableRawMode();
+    // -f: follow the files as they grow, see editorFollowStart()
+    int follow = (argc >= 2 && strcmp(argv[1], "-f") == 0);
+    int first = 1 + follow;
     initEditor();
-    if (argc >= 2) {
+    initTerminal();
+    // unless the syntax file had something to complain about
+    if (E.statusmsg[0] == '\0') {
+        editorSetStatusMessage("HELP: Ctrl-W save | Ctrl-Q quit | Ctrl-F find "
+                               "| Ctrl-R replace | Ctrl-Z undo");
+    }
+    // the other files wait in buffers of their own, see editorNextBuffer()
+    for (int i = first; i < argc; i++) {
+        if (i > first) {
+            E.buf = editorBufferNew();
+        }
         // read file and get all lines in the file
-        editorOpen(argv[1]);
+        editorOpen(argv[i]);
+        if (follow) {
+            editorFollowStart();
+        }
     }
+    E.buf = E.win->buf;
 
-    editorSetStatusMessage("HELP: Ctrl-W = save | Ctrl-Q = quit");
-
-    // read 1 byte from standard input into `c`
+    // every key that has arrived is handled before the screen is drawn
+    // again, so a burst of input costs one redraw
     while (1) {
         editorRefreshScreen();
-        editorProcessKeypress();
+        do {
+            editorProcessKeypress();
+            // keys like Page Down depend on where the view is
+            editorScroll();
+        } while (editorInputPending());
     }
 
     return 0;
 }
+#endif
+
+/*** character widths ***/
+
+// Generated from the Unicode 14.0 character database with Python:
+//
+//   import unicodedata as u
+//   def width(cp):
+//       c = chr(cp)
+//       if u.category(c) in ('Mn', 'Me', 'Cf') and cp != 0xad:
+//           return 0
+//       if 0x1160 <= cp < 0x1200 or 0xd7b0 <= cp < 0xd800 or cp == 0x200b:
+//           return 0
+//       return 2 if u.east_asian_width(c) in 'WF' else 1
+//   blocks, index = {}, []
+//   for hi in range(0x20000 >> 7):
+//       w = [width(hi << 7 | lo) for lo in range(128)]
+//       b = bytes(w[i] | w[i + 1] << 2 | w[i + 2] << 4 | w[i + 3] << 6
+//                 for i in range(0, 128, 4))
+//       index.append(blocks.setdefault(b, len(blocks)))
+//
+// `index` is charWidthIndex, and the blocks in order are charWidthBlocks
+static const unsigned char charWidthIndex[0x20000 >> 7] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x00, 0x03, 0x04, 0x05,
+    0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11,
+    0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x20, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x22, 0x23, 0x24,
+    0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x00, 0x2f,
+    0x00, 0x00, 0x30, 0x31, 0x32, 0x33, 0x00, 0x34, 0x00, 0x00, 0x35, 0x36,
+    0x37, 0x00, 0x00, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x3d, 0x3e, 0x00, 0x3f, 0x40, 0x41, 0x42, 0x43, 0x43, 0x43,
+    0x44, 0x45, 0x43, 0x43, 0x46, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x47,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x48, 0x00, 0x00, 0x49, 0x4a, 0x00, 0x4b,
+    0x4c, 0x4d, 0x4e, 0x4f, 0x50, 0x51, 0x52, 0x53, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x54,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x43, 0x43, 0x43, 0x43, 0x55, 0x56,
+    0x00, 0x00, 0x00, 0x57, 0x58, 0x59, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+    0x43, 0x60, 0x61, 0x62, 0x00, 0x63, 0x64, 0x65, 0x00, 0x00, 0x66, 0x67,
+    0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72, 0x43,
+    0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x43,
+    0x7e, 0x7f, 0x43, 0x80, 0x81, 0x82, 0x83, 0x43, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x43, 0x43, 0x8a, 0x8b, 0x8c, 0x8d, 0x43, 0x8e, 0x43, 0x8f,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x90, 0x91, 0x00, 0x92, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x93, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x94, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x00, 0x00, 0x00, 0x00, 0x95, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x00, 0x00, 0x00, 0x00, 0x96, 0x97, 0x98, 0x99, 0x43, 0x43, 0x43, 0x43,
+    0x47, 0x9a, 0x9b, 0x9c, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x9d, 0x9e, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x9f, 0x92, 0x00, 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0x43,
+    0xa6, 0xa7, 0xa8, 0x00, 0x00, 0xa9, 0x00, 0xaa, 0x00, 0x00, 0x00, 0x00,
+    0xab, 0xac, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43, 0xad, 0x43,
+    0xae, 0x43, 0xaf, 0x43, 0x43, 0xb0, 0x43, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0xb1, 0x00, 0xb2, 0xb3, 0x43, 0x43, 0x43, 0x43, 0x43,
+    0xb4, 0xb5, 0xb6, 0x43, 0xb7, 0xb8, 0x43, 0x43, 0xb9, 0xba, 0x00, 0xbb,
+    0x43, 0x43, 0xbc, 0xbd, 0xbe, 0xbf, 0xc0, 0xc1, 0x48, 0xc2, 0xc3, 0xc4,
+    0xc5, 0xc6, 0xc7, 0x43, 0xc8, 0x43, 0x00, 0xc9, 0x43, 0x43, 0x43, 0x43,
+    0x43, 0x43, 0x43, 0x43,
+};
+static const unsigned char charWidthBlocks[CHAR_WIDTH_BLOCKS * 32] = {
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x55, 0x55, 0x5a, 0x55, 0xaa, 0x55, 0x95, 0x59, 0x55, 0x55, 0x55, 0x55,
+    0x65, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x15, 0x00, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x56, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x56, 0x02, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x41, 0x10, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x6a, 0x55, 0xa9, 0xaa, 0xaa,
+    0x00, 0x50, 0x55, 0x55, 0x00, 0x00, 0x40, 0x54, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x55, 0x55, 0x55, 0x55, 0x54, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x00, 0x10, 0x00, 0x14, 0x04, 0x50,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x25, 0x51, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x56,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x00, 0x00,
+    0xa4, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x15, 0x00, 0x00, 0x55, 0x95, 0x52, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x05, 0x10, 0x00, 0x00, 0x01, 0x01, 0xa0, 0x55, 0x55, 0x55, 0x95,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x01, 0x9a, 0x55, 0x55, 0x95, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xa0, 0xaa, 0x00, 0x00,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x40, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x45, 0x54, 0x01, 0x00, 0x54, 0x51, 0x01, 0x00, 0x55, 0x55,
+    0x05, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x51, 0x56, 0x55, 0x69,
+    0x69, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0x55, 0x99, 0x5a, 0xa5, 0x54,
+    0x01, 0x68, 0x69, 0x91, 0xaa, 0x6a, 0xaa, 0x65, 0x05, 0x5a, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x85, 0x42, 0x56, 0x95, 0x6a, 0x69, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x59, 0x55, 0x59, 0x96, 0xa5, 0x58, 0x81, 0x2a, 0x28, 0xa0,
+    0xa2, 0xaa, 0x56, 0x99, 0xaa, 0x5a, 0x55, 0x55, 0x50, 0x91, 0xaa, 0xaa,
+    0x42, 0x56, 0x55, 0x65, 0x65, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0x55,
+    0x59, 0x56, 0xa5, 0x54, 0x01, 0x20, 0x64, 0xa1, 0xa9, 0xaa, 0xaa, 0xaa,
+    0x05, 0x5a, 0x55, 0x55, 0xa5, 0xaa, 0x06, 0x00, 0x52, 0x56, 0x55, 0x69,
+    0x69, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0x55, 0x59, 0x56, 0xa5, 0x14,
+    0x01, 0x68, 0x69, 0xa1, 0xaa, 0x42, 0xaa, 0x65, 0x05, 0x5a, 0x55, 0x55,
+    0x55, 0x55, 0xaa, 0xaa, 0x4a, 0x56, 0x95, 0x5a, 0x59, 0xa5, 0x96, 0x59,
+    0x6a, 0xa9, 0x95, 0x5a, 0x55, 0x55, 0xa5, 0x5a, 0x94, 0x5a, 0x59, 0xa1,
+    0xa9, 0x6a, 0xaa, 0xaa, 0xaa, 0x5a, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa,
+    0x54, 0x54, 0x55, 0x59, 0x59, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0x55,
+    0x55, 0x55, 0xa5, 0x04, 0x54, 0x09, 0x08, 0xa0, 0xaa, 0x82, 0x95, 0xa6,
+    0x05, 0x5a, 0x55, 0x55, 0xaa, 0x6a, 0x55, 0x55, 0x51, 0x55, 0x55, 0x59,
+    0x59, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0x55, 0x55, 0x56, 0xa5, 0x14,
+    0x55, 0x49, 0x59, 0xa0, 0xaa, 0x96, 0xaa, 0x96, 0x05, 0x5a, 0x55, 0x55,
+    0x96, 0xaa, 0xaa, 0xaa, 0x50, 0x55, 0x55, 0x59, 0x59, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x54, 0x01, 0x58, 0x59, 0x51,
+    0xaa, 0x55, 0x55, 0x55, 0x05, 0x5a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x52, 0x56, 0x55, 0x55, 0x55, 0x95, 0x5a, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x65, 0x55, 0x55, 0xa6, 0x55, 0x95, 0x8a, 0x6a, 0x05, 0x88, 0x55, 0x55,
+    0xaa, 0x5a, 0x55, 0x55, 0x5a, 0xa9, 0xaa, 0xaa, 0x56, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x51, 0x00, 0x80, 0x6a,
+    0x55, 0x15, 0x00, 0x40, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x96, 0x59, 0x95, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x66, 0x55, 0x55, 0x51, 0x00, 0x00, 0xa4, 0x55, 0x99, 0x00, 0xa0,
+    0x55, 0x55, 0xa5, 0x55, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x11, 0x51, 0x55, 0x55, 0x55, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0xa9, 0x02, 0x00, 0x00, 0x40, 0x00, 0x04, 0x55, 0x01,
+    0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x58,
+    0x55, 0x45, 0x55, 0x59, 0x55, 0x55, 0x95, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x01, 0x04, 0x00, 0x41, 0x41, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x50, 0x05, 0x54, 0x55, 0x55, 0x55, 0x01, 0x54, 0x55, 0x55,
+    0x45, 0x41, 0x55, 0x51, 0x55, 0x55, 0x55, 0x51, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x65, 0xaa, 0xa6, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0xa5, 0x55, 0x95, 0x59, 0xa5,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0xa5,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0xa5, 0x55, 0x95,
+    0x59, 0xa5, 0x55, 0x55, 0x55, 0x95, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0xa5, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x95, 0x02, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa9,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0x55, 0xa5, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0xa9, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0xa9, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x05, 0xa4, 0xaa, 0x6a,
+    0x55, 0x55, 0x55, 0x55, 0x05, 0x95, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x05, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x59, 0x09, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x10, 0x00, 0x50, 0x55, 0x45, 0x01, 0x00, 0x00, 0x55, 0x55, 0xa1,
+    0x55, 0x55, 0xa5, 0xaa, 0x55, 0x55, 0xa5, 0xaa, 0x55, 0x55, 0x15, 0x00,
+    0x55, 0x55, 0xa5, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0xa9, 0xaa, 0x55, 0x41, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x91, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x40, 0x15, 0x54, 0xaa,
+    0x45, 0x55, 0x01, 0xaa, 0xa9, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0xa5, 0x55, 0xa9, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0xa5, 0xaa, 0x55, 0x55, 0x95, 0x5a, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x14, 0x5a,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x45, 0x00, 0x80, 0x44, 0x01, 0x00, 0x54, 0x15, 0x00, 0x00, 0x28,
+    0x55, 0x55, 0xa5, 0xaa, 0x55, 0x55, 0xa5, 0xaa, 0x55, 0x55, 0x55, 0xa5,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x00, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x04, 0x40, 0x54,
+    0x45, 0x55, 0x55, 0xa9, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x00,
+    0x00, 0x55, 0x55, 0x95, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x05, 0x50, 0x10, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x45, 0x50, 0x11, 0x50, 0xaa, 0xaa, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00,
+    0x00, 0x05, 0x6a, 0x55, 0x55, 0x55, 0xa5, 0x56, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa9, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x56,
+    0x55, 0x55, 0xaa, 0xaa, 0x40, 0x00, 0x00, 0x00, 0x04, 0x00, 0x54, 0x51,
+    0x55, 0x54, 0x90, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0x55, 0xa5, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0x55, 0xa5, 0x55, 0x55, 0x66, 0x66,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0x55, 0x55,
+    0x55, 0x59, 0x55, 0x55, 0x55, 0x5a, 0x55, 0x56, 0x55, 0x55, 0x55, 0x55,
+    0x5a, 0x59, 0x55, 0x95, 0x55, 0x55, 0x15, 0x00, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x05, 0x40, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x00, 0x08, 0x00, 0x00, 0xa5, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x95, 0x55, 0x55, 0x55, 0xa9, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0xa9, 0xaa, 0xaa, 0xaa, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xa8, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0x55,
+    0x55, 0x55, 0x69, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0xa9, 0x56, 0x96, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x95, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x69,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x5a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x55, 0x55, 0x55, 0x55,
+    0x95, 0x55, 0x55, 0x55, 0x59, 0x55, 0xa5, 0x55, 0x55, 0x55, 0x55, 0x69,
+    0x55, 0x5a, 0x55, 0x65, 0x55, 0x56, 0x55, 0x55, 0x55, 0x55, 0x65, 0x55,
+    0xa5, 0x59, 0x65, 0x59, 0x55, 0x59, 0xa5, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x66,
+    0x95, 0x9a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0xa9, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x56, 0x55, 0x55, 0x95, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x95, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x56, 0x59, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x5a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x65, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x15, 0x50, 0xaa, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x65, 0xaa, 0xa6, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0x6a,
+    0xa9, 0xaa, 0xaa, 0x2a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0xaa,
+    0x55, 0x95, 0x55, 0x95, 0x55, 0x95, 0x55, 0x95, 0x55, 0x95, 0x55, 0x95,
+    0x55, 0x95, 0x55, 0x95, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0x0a, 0xa0, 0xaa, 0xaa, 0xaa, 0x6a, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x82, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15,
+    0x40, 0x00, 0x00, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x50, 0x55, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0x65, 0x56, 0xa5, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x5a, 0x55, 0x55, 0x55, 0x45, 0x45, 0x15, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x41, 0x55, 0xa8, 0x55, 0x55, 0xa5, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa0, 0xaa, 0x5a,
+    0x55, 0x55, 0xa5, 0xaa, 0x00, 0x00, 0x00, 0x00, 0x50, 0x55, 0x55, 0x15,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x00, 0x50,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x00, 0x00, 0x50, 0xaa, 0xaa, 0x6a,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x40, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x05, 0x50, 0x50,
+    0x55, 0x55, 0x55, 0x65, 0x55, 0x55, 0xa5, 0x5a, 0x55, 0x51, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x95, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x01, 0x40, 0x41, 0x81, 0xaa, 0xaa, 0x15, 0x55, 0x55, 0xa4,
+    0x55, 0x55, 0xa5, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x54,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x04, 0x14, 0x54, 0x05, 0x91, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x6a, 0x55,
+    0x55, 0x55, 0x55, 0x50, 0x55, 0x85, 0xaa, 0xaa, 0x56, 0x95, 0x56, 0x95,
+    0x56, 0x95, 0xaa, 0xaa, 0x55, 0x95, 0x55, 0x95, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x51, 0x54, 0xa1, 0x55, 0x55, 0xa5, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x55, 0x95, 0xaa, 0xaa,
+    0x6a, 0x55, 0xaa, 0x46, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x55, 0x99,
+    0x65, 0x59, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0xaa, 0xaa,
+    0x6a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x5a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0x6a, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x00, 0x00, 0x00, 0x00, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x59, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x29,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95,
+    0x5a, 0x55, 0x5a, 0x55, 0x5a, 0x55, 0x5a, 0xa9, 0xaa, 0xaa, 0x55, 0x95,
+    0xaa, 0xaa, 0x02, 0xa5, 0x55, 0x55, 0x55, 0x56, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x95, 0x55, 0x55, 0x55, 0x55, 0x95, 0x65, 0x55, 0x55, 0x55, 0xa5,
+    0x55, 0x55, 0x55, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0x95, 0x6a, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x6a, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x55, 0x55, 0x55, 0xa9,
+    0xa9, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa1,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa9, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa9, 0xaa, 0xaa, 0xaa,
+    0x54, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0x56, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x95, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x05, 0x80, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x65,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0x55, 0x55,
+    0x55, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0x55, 0x55, 0xa5, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0x6a,
+    0x55, 0x55, 0x95, 0x55, 0x55, 0x55, 0x95, 0x55, 0x95, 0x65, 0x55, 0x55,
+    0x65, 0x55, 0x55, 0x55, 0x65, 0x55, 0x65, 0xa9, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x95, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0xaa,
+    0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x65, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0x55, 0x95, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0xa5, 0x59, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x65, 0xa9, 0x69, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x65, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0x6a, 0x55, 0x55,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x95, 0xa5, 0x6a, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x6a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0x6a,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x5a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x01, 0x82, 0xaa, 0x00, 0x55, 0x56, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0xa5, 0x80, 0x2a, 0x55, 0x55, 0xa9, 0xaa, 0x55, 0x55, 0xa9, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x81, 0x6a, 0x55,
+    0x55, 0x95, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0xa5, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0x56, 0xa9, 0xaa, 0xaa, 0x56, 0x55,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0xa9, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0x5a, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00, 0xaa, 0xaa,
+    0x55, 0x55, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x95, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x25, 0xa4, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x00, 0x00, 0x54, 0x55, 0xa5, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x05, 0x50, 0xa5, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x95, 0xaa, 0xaa, 0x51, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00, 0x00, 0x00, 0x40, 0x55, 0xa5,
+    0x5a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x14, 0xa4, 0xaa, 0x2a,
+    0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x15, 0x40, 0x41, 0x51, 0x85, 0xaa, 0xaa, 0xa2, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0xa9, 0xaa, 0x55, 0x55, 0xa5, 0xaa, 0x40, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x00, 0x01, 0x00, 0x58, 0x55, 0x55,
+    0x55, 0x55, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x15, 0x95, 0xaa, 0xaa, 0x50, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x00, 0x40, 0x55, 0x55, 0x01, 0x14,
+    0x55, 0x55, 0x55, 0x55, 0x56, 0x55, 0x55, 0x55, 0x55, 0xa9, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x65, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15,
+    0x50, 0x04, 0x55, 0x85, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x95, 0x59, 0x65,
+    0x55, 0x55, 0x55, 0x65, 0x55, 0x55, 0xa5, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x15, 0x00, 0x80, 0xaa,
+    0x55, 0x55, 0xa5, 0xaa, 0x50, 0x56, 0x55, 0x69, 0x69, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x59, 0x55, 0x59, 0x56, 0x25, 0x54, 0x54, 0x69, 0x69, 0xa5,
+    0xa9, 0x6a, 0xaa, 0x56, 0x55, 0x0a, 0x00, 0xa8, 0x00, 0xa8, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x00, 0x00, 0x05, 0x44, 0x55, 0x55, 0x55, 0x55, 0x55, 0x46,
+    0xa5, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x00, 0x44, 0x15,
+    0x04, 0x55, 0xaa, 0xaa, 0x55, 0x55, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x05, 0xa0, 0x55, 0x10, 0x54, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0xa0, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x15, 0x00, 0x40, 0x11, 0x54, 0xa9, 0xaa, 0xaa, 0x55, 0x55, 0xa5, 0xaa,
+    0x55, 0x55, 0x55, 0xa9, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x51, 0x00, 0x10, 0xa5, 0xaa,
+    0x55, 0x55, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x02,
+    0x05, 0x10, 0x00, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15,
+    0x00, 0x00, 0x41, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x95, 0xaa, 0xaa, 0x6a, 0x55, 0x95, 0xa6, 0x55, 0x55, 0x96, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x65, 0x29, 0x44, 0x15, 0x95, 0xaa, 0xaa,
+    0x55, 0x55, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x5a, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00, 0x0a, 0x55,
+    0x54, 0xa9, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x01, 0x00, 0x40, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x00, 0x14, 0x40,
+    0x55, 0x15, 0xaa, 0xaa, 0x01, 0x40, 0x01, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x00, 0x00, 0x40, 0x50, 0x55,
+    0x95, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa9, 0xaa,
+    0x55, 0x55, 0x59, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x00, 0x80, 0x00, 0x10, 0x55, 0xa5, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0xa9, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x04, 0x81, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x95, 0x65, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x01, 0x80, 0x8a, 0x20, 0x00, 0x10, 0xaa, 0xaa,
+    0x55, 0x55, 0xa5, 0xaa, 0x55, 0x65, 0x59, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x95, 0x60, 0x11, 0xa9, 0xaa, 0x55, 0x55, 0xa5, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x15, 0x54, 0xa9, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xa9, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0xaa, 0x6a,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95,
+    0x55, 0xa9, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x00, 0x00, 0xa8, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0xa9, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95,
+    0x55, 0x55, 0xa5, 0x5a, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95,
+    0x55, 0x55, 0xa5, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5,
+    0x00, 0xa4, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x00, 0x40, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0xaa,
+    0x55, 0x55, 0x65, 0x55, 0x65, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0x56,
+    0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x95, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0x2a,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0xaa, 0x2a, 0x40, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xa8, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa,
+    0x55, 0x55, 0x55, 0xa9, 0x55, 0x55, 0xa9, 0xaa, 0x55, 0x55, 0xa5, 0x41,
+    0x00, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa0,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0xa5, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x95, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x15, 0x50, 0x55, 0x15, 0x00, 0x00, 0x00,
+    0x40, 0x01, 0x00, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x05, 0x50,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x95, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x05, 0xa4, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa9, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x59, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x59,
+    0x9a, 0x96, 0x56, 0x59, 0x55, 0x55, 0x65, 0x56, 0x55, 0x56, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x65, 0x95, 0x56, 0x55, 0x59, 0x55, 0x59, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x65, 0x95, 0x55, 0x99, 0x5a, 0x55, 0x59, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x5a,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x40, 0x15, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x54, 0x55, 0x51, 0x55, 0x55, 0x55, 0x54, 0x55, 0xaa,
+    0xaa, 0xaa, 0x2a, 0x00, 0x02, 0x00, 0x00, 0x00, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x28, 0x00, 0x20, 0x08, 0x80, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa9, 0x00, 0x40, 0x55, 0xa5,
+    0x55, 0x55, 0xa5, 0x5a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x85, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00, 0x55, 0x55, 0xa5, 0x6a,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x95, 0x55, 0x96, 0x55, 0x55, 0x55, 0x95, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x69, 0x55, 0x55, 0x00, 0x80, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x00, 0x40, 0xaa,
+    0x55, 0x55, 0xa5, 0x5a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa9, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x96, 0x69, 0x56, 0x55,
+    0x95, 0x55, 0x66, 0xaa, 0x9a, 0x6a, 0x66, 0x56, 0x96, 0x69, 0x66, 0x66,
+    0x96, 0x69, 0x95, 0x55, 0x95, 0x55, 0x56, 0x99, 0x55, 0x55, 0x65, 0x55,
+    0x55, 0x55, 0x55, 0xaa, 0x56, 0x56, 0x65, 0x55, 0x55, 0x55, 0x55, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xa5, 0xaa, 0xaa, 0xaa, 0x55, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x95,
+    0x56, 0x55, 0x55, 0x55, 0x56, 0x55, 0x55, 0x95, 0x56, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x65,
+    0xa9, 0xaa, 0x6a, 0x55, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x5a, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x56, 0x55, 0x55, 0xa9, 0xaa, 0x9a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xa6,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x6a, 0x95, 0xaa, 0x55, 0x55, 0x55,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x56, 0x56, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x6a,
+    0xa6, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x96,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0x5a, 0x55, 0x55, 0x95, 0x6a, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x65, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x69, 0x55, 0x55, 0x55, 0x56, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x95, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x5a, 0x55, 0x56,
+    0x6a, 0xa9, 0xaa, 0xaa, 0x55, 0x55, 0x95, 0xaa, 0x55, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa9, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0xaa, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xaa, 0xaa,
+    0x55, 0x55, 0xa5, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xa5,
+    0xa5, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x6a, 0xaa,
+    0xaa, 0x9a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0x55, 0xa5, 0xaa, 0xaa, 0xaa, 0xaa,
+    0x55, 0x55, 0x55, 0x55, 0x95, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x95, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0x55, 0x55, 0xa5, 0xaa,
+};